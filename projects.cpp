@@ -1,30 +1,263 @@
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <fstream>
 #include <vector>
 #include <iomanip>
 #include <limits>
 #include <cctype>
 #include <algorithm>
+#include <sstream>
+#include <map>
+#include <deque>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <atomic>
+#include <thread>
+#include <cstdlib>
+#include <cmath>
+#include <climits>
+#include <new>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 using namespace std;
 
+// Prices are exact integers in minor units (cents by default); build with
+// -DPRICE_DECIMALS=<n> for a different number of decimal places.
+#ifndef PRICE_DECIMALS
+#define PRICE_DECIMALS 2
+#endif
+
+typedef long long Money;
+
+// ========== STRING POOL ==========
+// Product names and categories are interned: each distinct string is kept
+// once in an append-only arena and products hold its 32-bit offset, so every
+// copy of a product (hash node, price index, undo stack, sort snapshots)
+// shares the bytes. An entry is a varint length followed by the characters.
+// The arena is a table of 64 KiB blocks that never move, so a string stays
+// readable while others are added. Strings are never freed; the pool grows
+// with the number of distinct names and categories seen, not with copies.
+
+const int POOL_BLOCK_BITS = 16;
+const unsigned long long POOL_BLOCK_SIZE = 1ULL << POOL_BLOCK_BITS;
+const int POOL_MAX_BLOCKS = 1 << (32 - POOL_BLOCK_BITS);
+
+char* poolBlocks[POOL_MAX_BLOCKS];
+unsigned long long poolEnd = 1;  // offset 0 is the empty string
+unsigned long long poolAllocated = 0;
+vector<unsigned int> poolIndex;  // open addressing on offsets, 0 = free slot
+size_t poolStrings = 0;
+
+string_view pooledText(unsigned int offset) {
+    if (offset == 0) return string_view();
+    
+    const unsigned char* entry = (const unsigned char*)poolBlocks[offset >> POOL_BLOCK_BITS] +
+                                 (offset & (POOL_BLOCK_SIZE - 1));
+    size_t length = 0;
+    int shift = 0;
+    while (*entry & 0x80) {
+        length |= (size_t)(*entry++ & 0x7F) << shift;
+        shift += 7;
+    }
+    length |= (size_t)*entry++ << shift;
+    return string_view((const char*)entry, length);
+}
+
+unsigned int poolHash(string_view text) {
+    unsigned int hash = 2166136261u;  // FNV-1a
+    for (size_t i = 0; i < text.size(); i++) {
+        hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+    }
+    return hash;
+}
+
+unsigned int appendPoolEntry(string_view text) {
+    unsigned char header[10];
+    int headerLength = 0;
+    size_t length = text.size();
+    while (length >= 0x80) {
+        header[headerLength++] = (unsigned char)(length | 0x80);
+        length >>= 7;
+    }
+    header[headerLength++] = (unsigned char)length;
+    unsigned long long entrySize = headerLength + text.size();
+    
+    // Entries never straddle blocks. One that does not fit starts a fresh
+    // run of blocks, backed by a single allocation when it is oversized.
+    unsigned long long mask = POOL_BLOCK_SIZE - 1;
+    unsigned long long used = poolEnd & mask;
+    if (poolBlocks[poolEnd >> POOL_BLOCK_BITS] == NULL || used + entrySize > POOL_BLOCK_SIZE) {
+        unsigned long long start = poolEnd & ~mask;
+        if (poolBlocks[poolEnd >> POOL_BLOCK_BITS] != NULL) {
+            start += POOL_BLOCK_SIZE;
+            used = 0;
+        }
+        unsigned long long blocks = (used + entrySize + mask) >> POOL_BLOCK_BITS;
+        if ((start >> POOL_BLOCK_BITS) + blocks > (unsigned long long)POOL_MAX_BLOCKS) throw bad_alloc();
+        
+        char* memory = new char[blocks * POOL_BLOCK_SIZE];
+        for (unsigned long long i = 0; i < blocks; i++) {
+            poolBlocks[(start >> POOL_BLOCK_BITS) + i] = memory + i * POOL_BLOCK_SIZE;
+        }
+        poolAllocated += blocks * POOL_BLOCK_SIZE;
+        poolEnd = start + used;
+    }
+    
+    unsigned int offset = (unsigned int)poolEnd;
+    char* entry = poolBlocks[offset >> POOL_BLOCK_BITS] + (offset & mask);
+    memcpy(entry, header, headerLength);
+    memcpy(entry + headerLength, text.data(), text.size());
+    poolEnd += entrySize;
+    return offset;
+}
+
+void growPoolIndex() {
+    vector<unsigned int> old;
+    old.swap(poolIndex);
+    poolIndex.assign(max((size_t)1024, old.size() * 2), 0);
+    
+    size_t mask = poolIndex.size() - 1;
+    for (size_t i = 0; i < old.size(); i++) {
+        if (old[i] == 0) continue;
+        size_t slot = poolHash(pooledText(old[i])) & mask;
+        while (poolIndex[slot] != 0) slot = (slot + 1) & mask;
+        poolIndex[slot] = old[i];
+    }
+}
+
+// Offset of the pooled copy of text, adding it on first use. Interning
+// happens on the thread that owns the catalog; readers on other threads
+// only ever see offsets that were already published to them.
+unsigned int internString(string_view text) {
+    if (text.empty()) return 0;
+    if (poolStrings * 2 >= poolIndex.size()) growPoolIndex();
+    
+    size_t mask = poolIndex.size() - 1;
+    for (size_t slot = poolHash(text) & mask; ; slot = (slot + 1) & mask) {
+        if (poolIndex[slot] == 0) {
+            poolIndex[slot] = appendPoolEntry(text);
+            poolStrings++;
+            return poolIndex[slot];
+        }
+        if (pooledText(poolIndex[slot]) == text) return poolIndex[slot];
+    }
+}
+
+unsigned long long poolMemoryBytes() {
+    return poolAllocated + poolIndex.size() * sizeof(unsigned int);
+}
+
+// A product's name or category: a 4-byte handle that converts to and from
+// string, so the rest of the code can keep treating it as text.
+struct PooledString {
+    unsigned int offset;
+    
+    PooledString() : offset(0) {}
+    PooledString(const string& text) : offset(internString(text)) {}
+    PooledString(const char* text) : offset(internString(text)) {}
+    
+    string_view view() const { return pooledText(offset); }
+    operator string() const { return string(view()); }
+    bool empty() const { return offset == 0; }
+    size_t length() const { return view().size(); }
+};
+
+// Interned, so equal text means equal offsets.
+bool operator==(const PooledString& a, const PooledString& b) {
+    return a.offset == b.offset;
+}
+
+bool operator!=(const PooledString& a, const PooledString& b) {
+    return a.offset != b.offset;
+}
+
+ostream& operator<<(ostream& out, const PooledString& text) {
+    return out << text.view();
+}
+
 struct Product {
     string id;
-    string name;
-    string category;
-    double price;
+    PooledString name;
+    PooledString category;
+    Money price;
     double rating;
     int stock;
     int sales;
+    int reorderThreshold;  // low-stock alert when stock drops below this
+};
+
+// Product IDs packed into two 64-bit words so the indexes compare and hash
+// them without touching the string. Valid IDs are 7-bit ASCII with no zero
+// bytes, so IDs of up to 16 characters pack (zero padded) into a unique
+// key. Longer IDs keep their first 16 bytes and set the spare top bit of
+// the last byte; equal keys with that bit set fall back to comparing strings.
+struct ProductKey {
+    unsigned long long words[2];
+};
+
+const unsigned long long LONG_ID_FLAG = 0x80ULL << 56;
+
+ProductKey makeProductKey(const string& id) {
+    ProductKey key;
+    key.words[0] = 0;
+    key.words[1] = 0;
+    memcpy(key.words, id.data(), min(id.size(), sizeof(key.words)));
+    if (id.size() > sizeof(key.words)) key.words[1] |= LONG_ID_FLAG;
+    return key;
+}
+
+bool sameKey(const ProductKey& a, const string& aId, const ProductKey& b, const string& bId) {
+    if (a.words[0] != b.words[0] || a.words[1] != b.words[1]) return false;
+    return (a.words[1] & LONG_ID_FLAG) == 0 || aId == bId;
+}
+
+// Per-product counters for order processing. They are updated with atomic
+// operations only, and committed quantities are folded into product.stock
+// and product.sales later in a batch (see applyStockBatch).
+struct StockCounters {
+    atomic<int> available;     // stock not reserved or already committed
+    atomic<int> reserved;      // held for orders that are not yet committed
+    atomic<int> pendingSold;   // committed units not yet taken off product.stock
+    atomic<int> pendingSales;  // sales not yet added to product.sales
+    atomic<bool> queued;       // already on dirtyStockList
 };
 
+struct SalesSeries;
+struct LocationStock;
+
 struct HashNode {
     Product product;
+    ProductKey key;
+    StockCounters counters;
     HashNode* next;
+    HashNode* dirtyNext;
+    int heapIndex;  // position in lowStockHeap
+    SalesSeries* series;  // sales history, created on the first event
+    vector<LocationStock>* locations;  // NULL: all stock at the default location
+    unsigned long long rowHash;  // hash of the file row it was loaded from, 0 once changed
+    unsigned int mergeStamp;     // last merge that saw the product in its file
+    atomic<bool> referenced;     // looked up since the cold tier's CLOCK hand passed;
+                                 // lookups on reservation threads set it too
+    int versionSlot;             // its versions for snapshots, -1 if none yet
 };
 
 struct BSTNode {
     Product product;
+    ProductKey key;
     BSTNode* left;
     BSTNode* right;
 };
@@ -42,6 +275,360 @@ StackNode* undoStack = NULL;
 StackNode* redoStack = NULL;
 Product productArray[1000];
 int productCount = 0;
+atomic<HashNode*> dirtyStockList(NULL);
+
+// ========== INSTRUMENTATION ==========
+// Per-operation call counts and latency histograms, plus allocation counts.
+// Build with -DINVENTORY_STATS=0 to compile all of it out of the hot paths.
+#ifndef INVENTORY_STATS
+#define INVENTORY_STATS 1
+#endif
+
+enum OperationKind {
+    OP_ADD, OP_SEARCH, OP_UPDATE, OP_DELETE, OP_DELETE_BST, OP_RANGE,
+    OP_MERGE_SORT, OP_QUICK_SORT, OP_SAVE, OP_LOAD, OP_MERGE, OP_COUNT
+};
+
+const char* operationNames[OP_COUNT] = {
+    "add", "search", "update", "delete", "deleteBST", "rangeSearch",
+    "mergeSort", "quickSort", "save", "load", "merge"
+};
+
+// Log-linear buckets in the style of HdrHistogram: values below 32ns get
+// their own bucket, larger values keep their top 5 significant bits, so
+// every bucket is within about 6% of the values it holds.
+const int HISTOGRAM_BUCKETS = 976;
+
+struct LatencyHistogram {
+    unsigned long long buckets[HISTOGRAM_BUCKETS];
+    unsigned long long count;
+    unsigned long long totalNs;
+    unsigned long long maxNs;
+};
+
+LatencyHistogram operationStats[OP_COUNT];
+
+int histogramBucket(unsigned long long ns) {
+    if (ns < 32) return ns;
+    int msb = 63 - __builtin_clzll(ns);
+    int shift = msb - 4;
+    return (shift + 1) * 16 + (int)((ns >> shift) - 16);
+}
+
+unsigned long long histogramBucketValue(int bucket) {
+    if (bucket < 32) return bucket;
+    int shift = bucket / 16 - 1;
+    unsigned long long low = (unsigned long long)(bucket % 16 + 16) << shift;
+    return low + ((1ULL << shift) >> 1);
+}
+
+void addLatencySample(LatencyHistogram& h, unsigned long long ns) {
+    h.buckets[histogramBucket(ns)]++;
+    h.count++;
+    h.totalNs += ns;
+    if (ns > h.maxNs) h.maxNs = ns;
+}
+
+void recordLatency(int op, unsigned long long ns) {
+    addLatencySample(operationStats[op], ns);
+}
+
+unsigned long long histogramPercentile(const LatencyHistogram& h, double percentile) {
+    if (h.count == 0) return 0;
+    unsigned long long target = (unsigned long long)(h.count * percentile / 100.0);
+    if (target >= h.count) target = h.count - 1;
+    unsigned long long seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += h.buckets[i];
+        if (seen > target) return min(histogramBucketValue(i), h.maxNs);
+    }
+    return h.maxNs;
+}
+
+struct OperationTimer {
+    int op;
+    chrono::steady_clock::time_point start;
+    
+    OperationTimer(int operation) : op(operation), start(chrono::steady_clock::now()) {}
+    ~OperationTimer() {
+        recordLatency(op, chrono::duration_cast<chrono::nanoseconds>(
+                              chrono::steady_clock::now() - start).count());
+    }
+};
+
+#if INVENTORY_STATS
+// Named after the line, so a nested timer does not shadow the outer one.
+#define TIME_OPERATION_JOIN(name, line) name##line
+#define TIME_OPERATION_NAME(line) TIME_OPERATION_JOIN(operationTimer_, line)
+#define TIME_OPERATION(op) OperationTimer TIME_OPERATION_NAME(__LINE__)(op)
+
+atomic<unsigned long long> allocationCount(0);
+atomic<unsigned long long> freeCount(0);
+atomic<unsigned long long> allocatedBytes(0);
+
+// Every form of new and delete is replaced, so nothing allocated through
+// one form is freed through another's allocator, and all of them count.
+void* countedAlloc(size_t size, size_t alignment) {
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    allocatedBytes.fetch_add(size, memory_order_relaxed);
+    if (size == 0) size = 1;
+    if (alignment <= alignof(max_align_t)) return malloc(size);
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+void countedFree(void* memory) {
+    if (memory == NULL) return;
+    freeCount.fetch_add(1, memory_order_relaxed);
+    free(memory);
+}
+
+void* operator new(size_t size) {
+    void* memory = countedAlloc(size, 0);
+    if (memory == NULL) throw bad_alloc();
+    return memory;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, align_val_t alignment) {
+    void* memory = countedAlloc(size, (size_t)alignment);
+    if (memory == NULL) throw bad_alloc();
+    return memory;
+}
+
+void* operator new[](size_t size, align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept {
+    return countedAlloc(size, 0);
+}
+
+void* operator new[](size_t size, const nothrow_t&) noexcept {
+    return countedAlloc(size, 0);
+}
+
+void* operator new(size_t size, align_val_t alignment, const nothrow_t&) noexcept {
+    return countedAlloc(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, align_val_t alignment, const nothrow_t&) noexcept {
+    return countedAlloc(size, (size_t)alignment);
+}
+
+void operator delete(void* memory) noexcept { countedFree(memory); }
+void operator delete[](void* memory) noexcept { countedFree(memory); }
+void operator delete(void* memory, size_t) noexcept { countedFree(memory); }
+void operator delete[](void* memory, size_t) noexcept { countedFree(memory); }
+void operator delete(void* memory, const nothrow_t&) noexcept { countedFree(memory); }
+void operator delete[](void* memory, const nothrow_t&) noexcept { countedFree(memory); }
+void operator delete(void* memory, align_val_t) noexcept { countedFree(memory); }
+void operator delete[](void* memory, align_val_t) noexcept { countedFree(memory); }
+void operator delete(void* memory, size_t, align_val_t) noexcept { countedFree(memory); }
+void operator delete[](void* memory, size_t, align_val_t) noexcept { countedFree(memory); }
+void operator delete(void* memory, align_val_t, const nothrow_t&) noexcept { countedFree(memory); }
+void operator delete[](void* memory, align_val_t, const nothrow_t&) noexcept { countedFree(memory); }
+#else
+#define TIME_OPERATION(op)
+#endif
+
+void resetStats() {
+    memset(operationStats, 0, sizeof(operationStats));
+}
+
+// ========== TRACE RECORDING ==========
+// With INVENTORY_TRACE=<file> set, every high-level operation is appended
+// to a compact binary trace that --replay can run again offline. Nested
+// calls (the adds inside a load, the delete inside an undo) are not
+// recorded, because replaying the outer operation repeats them.
+//
+// Format: "ITRC" + version byte, then per record: op byte, microseconds
+// since the previous record (varint), and the op's arguments. Strings are
+// a varint length plus bytes, ints are zigzag varints and doubles are raw
+// 8-byte values. Prices are Money, so they are written as ints.
+//
+// New ops are only ever appended, so older version 2 traces still replay.
+// TRACE_SORT (sort by price, rating or sales) is no longer recorded, since
+// every sort is now a TRACE_SORT_SPEC, but traces from before multi-key
+// sorts contain it and --replay still runs it.
+
+enum TraceOp {
+    TRACE_ADD = 1, TRACE_UPDATE, TRACE_DELETE, TRACE_SEARCH, TRACE_SORT,
+    TRACE_RANGE, TRACE_UNDO, TRACE_REDO, TRACE_SAVE, TRACE_LOAD, TRACE_MERGE, TRACE_SORT_SPEC,
+    TRACE_RESERVE, TRACE_RELEASE, TRACE_COMMIT, TRACE_SELL, TRACE_PLACE, TRACE_MOVE, TRACE_LOCATIONS,
+    TRACE_OP_COUNT
+};
+
+const char* traceOpNames[TRACE_OP_COUNT] = {
+    "", "add", "update", "delete", "search", "sort",
+    "range", "undo", "redo", "save", "load", "merge", "sortspec",
+    "reserve", "release", "commit", "sell", "place", "move", "locations"
+};
+
+const unsigned char TRACE_VERSION = 2;
+
+ofstream traceOut;
+bool traceRecording = false;
+int traceDepth = 0;
+chrono::steady_clock::time_point traceLastRecord;
+
+void writeVarint(ostream& out, unsigned long long value) {
+    while (value >= 0x80) {
+        out.put((char)(value | 0x80));
+        value >>= 7;
+    }
+    out.put((char)value);
+}
+
+bool readVarint(istream& in, unsigned long long& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = in.get();
+        if (byte == EOF) return false;
+        value |= (unsigned long long)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+void writeTraceInt(long long value) {
+    writeVarint(traceOut, ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63));
+}
+
+void writeTraceDouble(double value) {
+    traceOut.write((const char*)&value, sizeof(value));
+}
+
+void writeTraceString(const string& value) {
+    writeVarint(traceOut, value.size());
+    traceOut.write(value.data(), value.size());
+}
+
+void writeTraceProduct(const Product& p) {
+    writeTraceString(p.id);
+    writeTraceString(p.name);
+    writeTraceString(p.category);
+    writeTraceInt(p.price);
+    writeTraceDouble(p.rating);
+    writeTraceInt(p.stock);
+    writeTraceInt(p.sales);
+    writeTraceInt(p.reorderThreshold);
+}
+
+bool startTraceRecording(const string& filename) {
+    traceOut.open(filename, ios::binary | ios::trunc);
+    if (!traceOut) {
+        cerr << "Error: Could not open trace file '" << filename << "' for writing!\n";
+        return false;
+    }
+    traceOut.write("ITRC", 4);
+    traceOut.put((char)TRACE_VERSION);
+    traceLastRecord = chrono::steady_clock::now();
+    traceRecording = true;
+    return true;
+}
+
+// Records the operation if tracing is on and this is not a nested call;
+// active tells the caller whether to write the arguments.
+struct TraceScope {
+    bool active;
+    
+    TraceScope(int op) {
+        active = traceRecording && traceDepth == 0;
+        traceDepth++;
+        if (active) {
+            chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            traceOut.put((char)op);
+            writeVarint(traceOut, chrono::duration_cast<chrono::microseconds>(now - traceLastRecord).count());
+            traceLastRecord = now;
+        }
+    }
+    ~TraceScope() { traceDepth--; }
+};
+
+// ========== MONEY ==========
+// Parsing and formatting of Money without floating point, so prices
+// round-trip through files exactly. Input with more decimals than
+// PRICE_DECIMALS is rounded half up. Exponent notation is also accepted,
+// because earlier versions saved large prices as e.g. "1e+06".
+
+Money computePriceScale() {
+    Money scale = 1;
+    for (int i = 0; i < PRICE_DECIMALS; i++) scale *= 10;
+    return scale;
+}
+
+const Money PRICE_SCALE = computePriceScale();
+
+bool parseMoney(const string& text, Money& value) {
+    size_t i = 0;
+    bool negative = false;
+    if (i < text.length() && (text[i] == '-' || text[i] == '+')) {
+        negative = text[i] == '-';
+        i++;
+    }
+    
+    string digits;
+    int pointPos = -1;
+    for (; i < text.length() && (isdigit(text[i]) || text[i] == '.'); i++) {
+        if (text[i] == '.') {
+            if (pointPos >= 0) return false;
+            pointPos = digits.length();
+        } else {
+            digits += text[i];
+        }
+    }
+    if (digits.empty()) return false;
+    if (pointPos < 0) pointPos = digits.length();
+    
+    if (i < text.length() && (text[i] == 'e' || text[i] == 'E')) {
+        i++;
+        bool negativeExponent = false;
+        if (i < text.length() && (text[i] == '-' || text[i] == '+')) {
+            negativeExponent = text[i] == '-';
+            i++;
+        }
+        int exponent = 0;
+        size_t start = i;
+        for (; i < text.length() && isdigit(text[i]); i++) {
+            exponent = exponent * 10 + (text[i] - '0');
+            if (exponent > 40) return false;
+        }
+        if (i == start) return false;
+        pointPos += negativeExponent ? -exponent : exponent;
+    }
+    if (i != text.length()) return false;
+    
+    // Keep the digits down to PRICE_DECIMALS places after the point; the
+    // first dropped digit decides the rounding.
+    int kept = pointPos + PRICE_DECIMALS;
+    Money result = 0;
+    for (int k = 0; k < kept; k++) {
+        int digit = k < (int)digits.length() ? digits[k] - '0' : 0;
+        if (result > (LLONG_MAX - digit) / 10) return false;
+        result = result * 10 + digit;
+    }
+    if (kept >= 0 && kept < (int)digits.length() && digits[kept] >= '5') {
+        if (result == LLONG_MAX) return false;
+        result++;
+    }
+    
+    value = negative ? -result : result;
+    return true;
+}
+
+string formatMoney(Money value) {
+    string sign = value < 0 ? "-" : "";
+    unsigned long long magnitude = value < 0 ? -(unsigned long long)value : value;
+    string text = sign + to_string(magnitude / PRICE_SCALE);
+    if (PRICE_DECIMALS > 0) {
+        string fraction = to_string(magnitude % PRICE_SCALE);
+        text += "." + string(PRICE_DECIMALS - fraction.length(), '0') + fraction;
+    }
+    return text;
+}
 
 // ========== INPUT VALIDATION FUNCTIONS ==========
 bool isValidDoubleInput(const string& input) {
@@ -82,8 +669,12 @@ bool isValidSales(int sales) {
     return sales >= 0;
 }
 
-bool isValidPrice(double price) {
-    return price >= 0.0;
+bool isValidReorderThreshold(int threshold) {
+    return threshold >= 0;
+}
+
+bool isValidPrice(Money price) {
+    return price >= 0;
 }
 
 bool isValidProductID(const string& id) {
@@ -98,6 +689,10 @@ bool isValidProductID(const string& id) {
     return true;
 }
 
+bool isValidLocationName(const string& name) {
+    return isValidProductID(name);
+}
+
 bool isValidProductName(const string& name) {
     return !name.empty();
 }
@@ -155,6 +750,35 @@ double getDoubleInput(const string& prompt, double min = -1e9, double max = 1e9)
     }
 }
 
+Money getMoneyInput(const string& prompt, Money min, Money max) {
+    string input;
+    while (true) {
+        cout << prompt;
+        getline(cin, input);
+        
+        // Remove whitespace
+        input.erase(0, input.find_first_not_of(" \t\n\r\f\v"));
+        input.erase(input.find_last_not_of(" \t\n\r\f\v") + 1);
+        
+        if (input.empty()) {
+            cout << "Error: Input cannot be empty. Please try again.\n";
+            continue;
+        }
+        
+        Money value;
+        if (!parseMoney(input, value)) {
+            cout << "Error: Invalid amount. Please enter a number like 12.99.\n";
+            continue;
+        }
+        
+        if (value < min || value > max) {
+            cout << "Error: Value must be between " << formatMoney(min) << " and " << formatMoney(max) << ". Please try again.\n";
+            continue;
+        }
+        return value;
+    }
+}
+
 int getIntInput(const string& prompt, int min = -1e9, int max = 1e9) {
     string input;
     while (true) {
@@ -214,12 +838,9 @@ int getMenuChoice(int minChoice, int maxChoice) {
 }
 
 // ========== EXISTING FUNCTIONS WITH ERROR HANDLING ==========
-int hashFunction(string id) {
-    int hash = 0;
-    for (int i = 0; i < id.length(); i++) {
-        hash = hash * 31 + id[i];
-    }
-    if (hash < 0) hash = -hash;
+int hashKey(const ProductKey& key) {
+    unsigned long long hash = key.words[0] * 0x9E3779B97F4A7C15ULL ^ key.words[1] * 0xC2B2AE3D27D4EB4FULL;
+    hash ^= hash >> 32;
     return hash % 100;
 }
 
@@ -247,6 +868,7 @@ int popStack(StackNode* &stack, string &op, Product &p, Product &old) {
 BSTNode* createBSTNode(Product p) {
     BSTNode* newNode = new BSTNode;
     newNode->product = p;
+    newNode->key = makeProductKey(p.id);
     newNode->left = NULL;
     newNode->right = NULL;
     return newNode;
@@ -265,6 +887,21 @@ BSTNode* insertBST(BSTNode* root, Product p) {
     return root;
 }
 
+// Equal prices are always inserted to the right, and deleteBSTAt keeps that
+// property, so a product can be found by walking its price path.
+BSTNode* findBSTNode(BSTNode* root, Money price, const ProductKey& key, const string& id) {
+    while (root != NULL) {
+        if (price < root->product.price) {
+            root = root->left;
+        } else if (sameKey(root->key, root->product.id, key, id)) {
+            return root;
+        } else {
+            root = root->right;
+        }
+    }
+    return NULL;
+}
+
 BSTNode* findMinBST(BSTNode* root) {
     while (root != NULL && root->left != NULL) {
         root = root->left;
@@ -272,151 +909,350 @@ BSTNode* findMinBST(BSTNode* root) {
     return root;
 }
 
-BSTNode* deleteBST(BSTNode* root, string id) {
+// Walks the price path to the product, so only one root-to-leaf path is
+// visited. A two-child node takes its successor, which is never cheaper,
+// so equal prices stay to the right.
+BSTNode* deleteBSTAt(BSTNode* root, Money price, const ProductKey& key, const string& id) {
     if (root == NULL) return root;
     
-    if (root->product.id == id) {
-        if (root->left == NULL) {
-            BSTNode* temp = root->right;
-            delete root;
-            return temp;
-        } else if (root->right == NULL) {
-            BSTNode* temp = root->left;
-            delete root;
-            return temp;
-        }
-        
+    if (price < root->product.price) {
+        root->left = deleteBSTAt(root->left, price, key, id);
+    } else if (!sameKey(root->key, root->product.id, key, id)) {
+        root->right = deleteBSTAt(root->right, price, key, id);
+    } else if (root->left == NULL || root->right == NULL) {
+        BSTNode* child = root->left != NULL ? root->left : root->right;
+        delete root;
+        return child;
+    } else {
         BSTNode* temp = findMinBST(root->right);
         root->product = temp->product;
-        root->right = deleteBST(root->right, temp->product.id);
-    } else {
-        root->left = deleteBST(root->left, id);
-        root->right = deleteBST(root->right, id);
+        root->key = temp->key;
+        root->right = deleteBSTAt(root->right, root->product.price, root->key, root->product.id);
     }
     return root;
 }
 
-void rangeSearchBST(BSTNode* root, double minPrice, double maxPrice) {
+void collectRangeBST(BSTNode* root, Money minPrice, Money maxPrice, vector<Product>& out) {
     if (root == NULL) return;
     
     if (root->product.price > minPrice) {
-        rangeSearchBST(root->left, minPrice, maxPrice);
+        collectRangeBST(root->left, minPrice, maxPrice, out);
     }
     
     if (root->product.price >= minPrice && root->product.price <= maxPrice) {
-        cout << "ID: " << root->product.id << "\tName: " << root->product.name 
-             << "\tPrice: $" << root->product.price << endl;
+        out.push_back(root->product);
     }
     
-    if (root->product.price < maxPrice) {
-        rangeSearchBST(root->right, minPrice, maxPrice);
+    // Equal prices live in the right subtree, so it is needed up to maxPrice.
+    if (root->product.price <= maxPrice) {
+        collectRangeBST(root->right, minPrice, maxPrice, out);
     }
 }
 
-void mergeProducts(Product arr[], int left, int mid, int right, int sortBy, bool ascending) {
-    int n1 = mid - left + 1;
-    int n2 = right - mid;
-    
-    Product* leftArr = new Product[n1];
-    Product* rightArr = new Product[n2];
-    
-    for (int i = 0; i < n1; i++) leftArr[i] = arr[left + i];
-    for (int i = 0; i < n2; i++) rightArr[i] = arr[mid + 1 + i];
-    
-    int i = 0, j = 0, k = left;
-    
-    while (i < n1 && j < n2) {
-        bool shouldSwap;
-        
-        if (sortBy == 1) {
-            if (ascending) {
-                shouldSwap = leftArr[i].price <= rightArr[j].price;
-            } else {
-                shouldSwap = leftArr[i].price >= rightArr[j].price;
-            }
-        } else if (sortBy == 2) {
-            if (ascending) {
-                shouldSwap = leftArr[i].rating <= rightArr[j].rating;
-            } else {
-                shouldSwap = leftArr[i].rating >= rightArr[j].rating;
-            }
-        } else {
-            if (ascending) {
-                shouldSwap = leftArr[i].sales <= rightArr[j].sales;
-            } else {
-                shouldSwap = leftArr[i].sales >= rightArr[j].sales;
-            }
+// ========== SORTING ==========
+// Sorts take a SortSpec: one or more (field, direction) keys compared in
+// turn, such as "category asc, sales desc, name asc". Before a sort, every
+// key of every product is encoded once as an unsigned 64-bit integer whose
+// order is the order wanted: numbers are shifted or have their sign bits
+// flipped, descending keys are inverted, and IDs, names and categories
+// become their rank in a dictionary of the distinct values, so each
+// string is compared only while the dictionary is built. Merge Sort and
+// Quick Sort then compare integers and move int indices, not Products.
+//
+// Text collates case-insensitively (ASCII), with byte order breaking ties
+// so that distinct strings never rank equal.
+
+enum SortField {
+    SORT_ID, SORT_NAME, SORT_CATEGORY, SORT_PRICE, SORT_RATING, SORT_STOCK, SORT_SALES,
+    SORT_THRESHOLD, SORT_FIELD_COUNT
+};
+
+const char* sortFieldNames[SORT_FIELD_COUNT] = {
+    "id", "name", "category", "price", "rating", "stock", "sales", "threshold"
+};
+
+struct SortKey {
+    int field;
+    bool ascending;
+};
+
+// Each field at most once, so SORT_FIELD_COUNT keys at most.
+struct SortSpec {
+    int count;
+    SortKey keys[SORT_FIELD_COUNT];
+};
+
+// The single-field sorts of the menu: 1=price, 2=rating, else sales.
+SortSpec singleKeySpec(int sortBy, bool ascending) {
+    SortSpec spec;
+    spec.count = 1;
+    spec.keys[0].field = sortBy == 1 ? SORT_PRICE : sortBy == 2 ? SORT_RATING : SORT_SALES;
+    spec.keys[0].ascending = ascending;
+    return spec;
+}
+
+// Parses an optional "asc" / "desc" word; empty means ascending.
+bool parseSortOrder(const string& word, bool& ascending) {
+    string lower = word;
+    for (size_t i = 0; i < lower.length(); i++) {
+        lower[i] = tolower(lower[i]);
+    }
+    if (lower.empty() || lower == "asc") ascending = true;
+    else if (lower == "desc") ascending = false;
+    else return false;
+    return true;
+}
+
+// Parses "field [asc|desc], field [asc|desc], ...".
+bool parseSortSpec(const string& text, SortSpec& spec, string& error) {
+    spec.count = 0;
+    stringstream keys(text);
+    string key;
+    while (getline(keys, key, ',')) {
+        istringstream words(key);
+        string name, order, extra;
+        words >> name >> order >> extra;
+        for (size_t i = 0; i < name.length(); i++) {
+            name[i] = tolower(name[i]);
         }
         
-        if (shouldSwap) {
-            arr[k++] = leftArr[i++];
-        } else {
-            arr[k++] = rightArr[j++];
+        int field = 0;
+        while (field < SORT_FIELD_COUNT && name != sortFieldNames[field]) field++;
+        bool ascending;
+        if (field == SORT_FIELD_COUNT) {
+            error = "Unknown sort field '" + name + "'";
+            return false;
+        }
+        if (!parseSortOrder(order, ascending) || !extra.empty()) {
+            error = "Expected 'asc' or 'desc' after '" + name + "'";
+            return false;
+        }
+        for (int i = 0; i < spec.count; i++) {
+            if (spec.keys[i].field == field) {
+                error = "Field '" + name + "' is listed twice";
+                return false;
+            }
         }
+        spec.keys[spec.count].field = field;
+        spec.keys[spec.count].ascending = ascending;
+        spec.count++;
     }
-    
-    while (i < n1) arr[k++] = leftArr[i++];
-    while (j < n2) arr[k++] = rightArr[j++];
-    
-    delete[] leftArr;
-    delete[] rightArr;
+    if (spec.count == 0) {
+        error = "No sort fields given";
+        return false;
+    }
+    return true;
 }
 
-void mergeSortProducts(Product arr[], int left, int right, int sortBy, bool ascending) {
-    if (left < right) {
-        int mid = left + (right - left) / 2;
-        mergeSortProducts(arr, left, mid, sortBy, ascending);
-        mergeSortProducts(arr, mid + 1, right, sortBy, ascending);
-        mergeProducts(arr, left, mid, right, sortBy, ascending);
+string formatSortSpec(const SortSpec& spec) {
+    string text;
+    for (int i = 0; i < spec.count; i++) {
+        if (i > 0) text += ", ";
+        text += sortFieldNames[spec.keys[i].field];
+        text += spec.keys[i].ascending ? " asc" : " desc";
     }
+    return text;
 }
 
-void quickSortProducts(Product arr[], int low, int high, int sortBy, bool ascending) {
-    if (low < high) {
-        Product pivot = arr[high];
-        int i = low - 1;
-        
-        for (int j = low; j < high; j++) {
-            bool shouldSwap;
-            
-            if (sortBy == 1) {
-                if (ascending) {
-                    shouldSwap = arr[j].price <= pivot.price;
-                } else {
-                    shouldSwap = arr[j].price >= pivot.price;
-                }
-            } else if (sortBy == 2) {
-                if (ascending) {
-                    shouldSwap = arr[j].rating <= pivot.rating;
-                } else {
-                    shouldSwap = arr[j].rating >= pivot.rating;
-                }
-            } else {
-                if (ascending) {
-                    shouldSwap = arr[j].sales <= pivot.sales;
-                } else {
-                    shouldSwap = arr[j].sales >= pivot.sales;
-                }
-            }
-            
-            if (shouldSwap) {
-                i++;
-                Product temp = arr[i];
-                arr[i] = arr[j];
-                arr[j] = temp;
+int compareCollated(string_view a, string_view b) {
+    size_t n = min(a.size(), b.size());
+    for (size_t i = 0; i < n; i++) {
+        int x = tolower((unsigned char)a[i]), y = tolower((unsigned char)b[i]);
+        if (x != y) return x < y ? -1 : 1;
+    }
+    if (a.size() != b.size()) return a.size() < b.size() ? -1 : 1;
+    return a.compare(b) < 0 ? -1 : a.compare(b) > 0 ? 1 : 0;
+}
+
+// Negative, zero or positive as a sorts before, with or after b. Used
+// where only a few comparisons are needed, so no keys are built.
+int compareProductsBy(const Product& a, const Product& b, const SortSpec& spec) {
+    for (int i = 0; i < spec.count; i++) {
+        int result = 0;
+        switch (spec.keys[i].field) {
+            case SORT_ID: result = compareCollated(a.id, b.id); break;
+            case SORT_NAME: result = a.name == b.name ? 0 : compareCollated(a.name.view(), b.name.view()); break;
+            case SORT_CATEGORY:
+                result = a.category == b.category ? 0 : compareCollated(a.category.view(), b.category.view());
+                break;
+            case SORT_PRICE: result = (a.price > b.price) - (a.price < b.price); break;
+            case SORT_RATING: result = (a.rating > b.rating) - (a.rating < b.rating); break;
+            case SORT_STOCK: result = (a.stock > b.stock) - (a.stock < b.stock); break;
+            case SORT_SALES: result = (a.sales > b.sales) - (a.sales < b.sales); break;
+            case SORT_THRESHOLD:
+                result = (a.reorderThreshold > b.reorderThreshold) - (a.reorderThreshold < b.reorderThreshold);
+                break;
+        }
+        if (result != 0) return spec.keys[i].ascending ? result : -result;
+    }
+    return 0;
+}
+
+unsigned long long orderedInteger(long long value) {
+    return (unsigned long long)value ^ (1ULL << 63);
+}
+
+unsigned long long orderedDouble(double value) {
+    if (value == 0.0) value = 0.0;  // -0.0 compares equal to 0.0
+    unsigned long long bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits & (1ULL << 63)) ? ~bits : bits | (1ULL << 63);
+}
+
+// Rank of each text among the distinct texts, in collation order.
+void rankTexts(const vector<string_view>& texts, vector<unsigned long long>& ranks) {
+    vector<int> order(texts.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    sort(order.begin(), order.end(), [&texts](int a, int b) { return compareCollated(texts[a], texts[b]) < 0; });
+    
+    ranks.assign(texts.size(), 0);
+    for (size_t i = 1; i < order.size(); i++) {
+        bool same = compareCollated(texts[order[i - 1]], texts[order[i]]) == 0;
+        ranks[order[i]] = ranks[order[i - 1]] + (same ? 0 : 1);
+    }
+}
+
+// Pooled names and categories are ranked once per distinct offset.
+void rankPooledField(const Product arr[], int n, int field, vector<unsigned long long>& out) {
+    vector<unsigned int> offsets(n);
+    for (int i = 0; i < n; i++) {
+        offsets[i] = field == SORT_NAME ? arr[i].name.offset : arr[i].category.offset;
+    }
+    vector<unsigned int> distinct(offsets);
+    sort(distinct.begin(), distinct.end());
+    distinct.erase(unique(distinct.begin(), distinct.end()), distinct.end());
+    
+    vector<string_view> texts(distinct.size());
+    for (size_t i = 0; i < distinct.size(); i++) texts[i] = pooledText(distinct[i]);
+    vector<unsigned long long> ranks;
+    rankTexts(texts, ranks);
+    
+    out.resize(n);
+    for (int i = 0; i < n; i++) {
+        out[i] = ranks[lower_bound(distinct.begin(), distinct.end(), offsets[i]) - distinct.begin()];
+    }
+}
+
+// keys[i * spec.count + k] is key k of arr[i].
+void buildSortKeys(const Product arr[], int n, const SortSpec& spec, vector<unsigned long long>& keys) {
+    keys.assign((size_t)n * spec.count, 0);
+    vector<unsigned long long> column;
+    for (int k = 0; k < spec.count; k++) {
+        int field = spec.keys[k].field;
+        if (field == SORT_ID) {
+            vector<string_view> ids(n);
+            for (int i = 0; i < n; i++) ids[i] = arr[i].id;
+            rankTexts(ids, column);
+        } else if (field == SORT_NAME || field == SORT_CATEGORY) {
+            rankPooledField(arr, n, field, column);
+        } else {
+            column.resize(n);
+            for (int i = 0; i < n; i++) {
+                const Product& p = arr[i];
+                if (field == SORT_PRICE) column[i] = orderedInteger(p.price);
+                else if (field == SORT_RATING) column[i] = orderedDouble(p.rating);
+                else if (field == SORT_STOCK) column[i] = orderedInteger(p.stock);
+                else if (field == SORT_SALES) column[i] = orderedInteger(p.sales);
+                else column[i] = orderedInteger(p.reorderThreshold);
             }
         }
         
-        Product temp = arr[i + 1];
-        arr[i + 1] = arr[high];
-        arr[high] = temp;
+        bool ascending = spec.keys[k].ascending;
+        for (int i = 0; i < n; i++) {
+            keys[(size_t)i * spec.count + k] = ascending ? column[i] : ~column[i];
+        }
+    }
+}
+
+struct SortKeys {
+    const unsigned long long* keys;
+    int count;
+};
+
+int compareSortKeys(const SortKeys& sortKeys, int a, int b) {
+    const unsigned long long* x = sortKeys.keys + (size_t)a * sortKeys.count;
+    const unsigned long long* y = sortKeys.keys + (size_t)b * sortKeys.count;
+    for (int k = 0; k < sortKeys.count; k++) {
+        if (x[k] != y[k]) return x[k] < y[k] ? -1 : 1;
+    }
+    return 0;
+}
+
+void mergeIndices(int arr[], int left, int mid, int right, const SortKeys& sortKeys) {
+    int n1 = mid - left + 1;
+    int n2 = right - mid;
+    
+    int* leftArr = new int[n1];
+    int* rightArr = new int[n2];
+    
+    for (int i = 0; i < n1; i++) leftArr[i] = arr[left + i];
+    for (int i = 0; i < n2; i++) rightArr[i] = arr[mid + 1 + i];
+    
+    int i = 0, j = 0, k = left;
+    
+    // Taking from the left on ties keeps the sort stable.
+    while (i < n1 && j < n2) {
+        if (compareSortKeys(sortKeys, leftArr[i], rightArr[j]) <= 0) {
+            arr[k++] = leftArr[i++];
+        } else {
+            arr[k++] = rightArr[j++];
+        }
+    }
+    
+    while (i < n1) arr[k++] = leftArr[i++];
+    while (j < n2) arr[k++] = rightArr[j++];
+    
+    delete[] leftArr;
+    delete[] rightArr;
+}
+
+void mergeSortIndices(int arr[], int left, int right, const SortKeys& sortKeys) {
+    if (left < right) {
+        int mid = left + (right - left) / 2;
+        mergeSortIndices(arr, left, mid, sortKeys);
+        mergeSortIndices(arr, mid + 1, right, sortKeys);
+        mergeIndices(arr, left, mid, right, sortKeys);
+    }
+}
+
+void quickSortIndices(int arr[], int low, int high, const SortKeys& sortKeys) {
+    if (low < high) {
+        int pivot = arr[high];
+        int i = low - 1;
+        
+        for (int j = low; j < high; j++) {
+            if (compareSortKeys(sortKeys, arr[j], pivot) <= 0) {
+                i++;
+                swap(arr[i], arr[j]);
+            }
+        }
+        swap(arr[i + 1], arr[high]);
         
         int pi = i + 1;
-        quickSortProducts(arr, low, pi - 1, sortBy, ascending);
-        quickSortProducts(arr, pi + 1, high, sortBy, ascending);
+        quickSortIndices(arr, low, pi - 1, sortKeys);
+        quickSortIndices(arr, pi + 1, high, sortKeys);
     }
 }
 
+// Sorts arr[0..n) by the spec with Merge Sort (algorithm 1) or Quick Sort.
+void sortProductArray(Product arr[], int n, const SortSpec& spec, int algorithm) {
+    if (n < 2) return;
+    TIME_OPERATION(algorithm == 1 ? OP_MERGE_SORT : OP_QUICK_SORT);
+    
+    vector<unsigned long long> keys;
+    buildSortKeys(arr, n, spec, keys);
+    SortKeys sortKeys = {keys.data(), spec.count};
+    
+    vector<int> order(n);
+    for (int i = 0; i < n; i++) order[i] = i;
+    if (algorithm == 1) mergeSortIndices(order.data(), 0, n - 1, sortKeys);
+    else quickSortIndices(order.data(), 0, n - 1, sortKeys);
+    
+    vector<Product> sorted(n);
+    for (int i = 0; i < n; i++) sorted[i] = arr[order[i]];
+    for (int i = 0; i < n; i++) arr[i] = sorted[i];
+}
+
 void copyProductsToArray() {
     productCount = 0;
     for (int i = 0; i < 100; i++) {
@@ -429,7 +1265,7 @@ void copyProductsToArray() {
     }
 }
 
-void displayProducts(Product arr[], int n) {
+void displayProducts(const Product arr[], int n) {
     if (n == 0) {
         cout << "No products to display.\n";
         return;
@@ -437,396 +1273,4858 @@ void displayProducts(Product arr[], int n) {
     
     cout << "\n" << left << setw(8) << "ID";
     cout << left << setw(25) << "Name";
+    cout << left << setw(20) << "Category";
     cout << left << setw(12) << "Price";
     cout << left << setw(8) << "Rating";
     cout << left << setw(10) << "Stock";
     cout << left << setw(8) << "Sales\n";
-    cout << string(70, '-') << endl;
+    cout << string(90, '-') << endl;
     for (int i = 0; i < n; i++) {
         cout << left << setw(8) << arr[i].id;
         cout << left << setw(25) << arr[i].name;
-        cout << "$" << left << setw(11) << fixed << setprecision(2) << arr[i].price;
+        cout << left << setw(20) << arr[i].category;
+        cout << "$" << left << setw(11) << formatMoney(arr[i].price);
         cout << left << setw(8) << fixed << setprecision(1) << arr[i].rating;
         cout << left << setw(10) << arr[i].stock;
         cout << left << setw(8) << arr[i].sales << endl;
     }
-    cout << string(70, '-') << endl;
+    cout << string(90, '-') << endl;
 }
 
-void initSystem() {
-    for (int i = 0; i < 100; i++) {
-        hashTable[i] = NULL;
+// ========== CHANGE FEED ==========
+// Every add, update and delete is published to a fixed ring of events with
+// increasing sequence numbers, so caches and reorder systems can follow the
+// catalog instead of rescanning it. There is one producer (the thread that
+// mutates the catalog). Each registered consumer has its own cursor and may
+// poll from its own thread; the producer never overwrites an event a
+// consumer has not read yet, and waits for it instead. Readers on the
+// producer's thread can keep their own cursor with readChangesSince.
+
+const int CHANGE_FEED_CAPACITY = 4096;   // must be a power of two
+const int MAX_FEED_CONSUMERS = 8;
+
+struct ChangeEvent {
+    long long sequence;
+    char type;        // 'A' add, 'U' update, 'D' delete, 'C' catalog cleared
+    Product product;  // state after the change (the removed product for 'D')
+};
+
+struct FeedConsumer {
+    atomic<bool> active;
+    atomic<long long> cursor;  // next sequence this consumer will read
+};
+
+ChangeEvent changeFeed[CHANGE_FEED_CAPACITY];
+atomic<long long> feedPublished(0);  // sequence of the next event to publish
+FeedConsumer feedConsumers[MAX_FEED_CONSUMERS];
+long long feedWaits = 0;             // publishes that waited for a slow consumer
+
+long long slowestFeedCursor(long long published) {
+    long long slowest = published;
+    for (int i = 0; i < MAX_FEED_CONSUMERS; i++) {
+        if (feedConsumers[i].active.load(memory_order_acquire)) {
+            slowest = min(slowest, feedConsumers[i].cursor.load(memory_order_acquire));
+        }
     }
-    bstRoot = NULL;
-    undoStack = NULL;
-    redoStack = NULL;
-    productCount = 0;
+    return slowest;
 }
 
-void addProduct(Product p) {
-    if (!isValidProductID(p.id)) {
-        cout << "Error: Invalid Product ID!\n";
-        return;
-    }
+void publishChange(char type, const Product& p) {
+    long long sequence = feedPublished.load(memory_order_relaxed);
     
-    if (!isValidProductName(p.name)) {
-        cout << "Error: Product name cannot be empty!\n";
-        return;
+    // Backpressure: wait for the slowest consumer to free the slot.
+    if (sequence - slowestFeedCursor(sequence) >= CHANGE_FEED_CAPACITY) {
+        feedWaits++;
+        while (sequence - slowestFeedCursor(sequence) >= CHANGE_FEED_CAPACITY) {
+            this_thread::yield();
+        }
     }
     
-    if (!isValidPrice(p.price)) {
-        cout << "Error: Price must be non-negative!\n";
-        return;
+    ChangeEvent& event = changeFeed[sequence & (CHANGE_FEED_CAPACITY - 1)];
+    event.sequence = sequence;
+    event.type = type;
+    event.product = p;
+    feedPublished.store(sequence + 1, memory_order_release);
+}
+
+// Registers a consumer that starts with the next published event.
+// Returns its id, or -1 if all consumer slots are taken.
+int subscribeChanges() {
+    for (int i = 0; i < MAX_FEED_CONSUMERS; i++) {
+        bool expected = false;
+        if (!feedConsumers[i].active.load() &&
+            feedConsumers[i].active.compare_exchange_strong(expected, true)) {
+            feedConsumers[i].cursor.store(feedPublished.load(memory_order_acquire), memory_order_release);
+            return i;
+        }
     }
-    
-    if (!isValidRating(p.rating)) {
-        cout << "Error: Rating must be between 0.0 and 5.0!\n";
-        return;
+    return -1;
+}
+
+void unsubscribeChanges(int consumer) {
+    if (consumer >= 0 && consumer < MAX_FEED_CONSUMERS) {
+        feedConsumers[consumer].active.store(false, memory_order_release);
     }
+}
+
+// Copies up to maxEvents unread events and advances the consumer's cursor.
+int pollChanges(int consumer, vector<ChangeEvent>& out, int maxEvents) {
+    out.clear();
+    if (consumer < 0 || consumer >= MAX_FEED_CONSUMERS || !feedConsumers[consumer].active) return 0;
     
-    if (!isValidStock(p.stock)) {
-        cout << "Error: Stock must be non-negative!\n";
-        return;
-    }
+    FeedConsumer& reader = feedConsumers[consumer];
+    long long cursor = reader.cursor.load(memory_order_relaxed);
+    long long published = feedPublished.load(memory_order_acquire);
     
-    if (!isValidSales(p.sales)) {
-        cout << "Error: Sales must be non-negative!\n";
-        return;
+    while (cursor < published && (int)out.size() < maxEvents) {
+        out.push_back(changeFeed[cursor & (CHANGE_FEED_CAPACITY - 1)]);
+        cursor++;
+    }
+    reader.cursor.store(cursor, memory_order_release);
+    return out.size();
+}
+
+int feedConsumerCount() {
+    int count = 0;
+    for (int i = 0; i < MAX_FEED_CONSUMERS; i++) {
+        if (feedConsumers[i].active.load(memory_order_acquire)) count++;
     }
+    return count;
+}
+
+// Unregistered read from the producer's own thread, for callers that keep
+// their own cursor. Returns false if events after sequence were already
+// overwritten, in which case the caller has to resynchronise from scratch.
+bool readChangesSince(long long sequence, vector<ChangeEvent>& out, int maxEvents) {
+    out.clear();
+    long long published = feedPublished.load(memory_order_acquire);
+    if (sequence < published - CHANGE_FEED_CAPACITY || sequence < 0) return false;
     
-    int index = hashFunction(p.id);
+    while (sequence < published && (int)out.size() < maxEvents) {
+        out.push_back(changeFeed[sequence & (CHANGE_FEED_CAPACITY - 1)]);
+        sequence++;
+    }
+    return true;
+}
+
+// With INVENTORY_FEED_LOG=<file> set, a logger thread follows the feed as
+// a registered consumer and appends every event to the file as
+// "seq,type,row" lines, so another system can replicate the catalog.
+struct FeedLog {
+    thread worker;
+    atomic<bool> stopping;
     
-    HashNode* current = hashTable[index];
-    while (current != NULL) {
-        if (current->product.id == p.id) {
-            cout << "Error: Product ID already exists!\n";
-            return;
+    // Drains the feed before the program ends.
+    ~FeedLog() {
+        if (worker.joinable()) {
+            stopping.store(true, memory_order_release);
+            worker.join();
         }
-        current = current->next;
     }
+};
+
+FeedLog feedLog;
+
+void writeProductCSV(ostream& out, const Product& p);  // with the CSV code
+
+void runFeedLog(ofstream* file, int consumer) {
+    vector<ChangeEvent> events;
+    while (true) {
+        bool stop = feedLog.stopping.load(memory_order_acquire);
+        pollChanges(consumer, events, 256);
+        for (size_t i = 0; i < events.size(); i++) {
+            *file << events[i].sequence << "," << events[i].type;
+            if (events[i].type != 'C') {
+                *file << ",";
+                writeProductCSV(*file, events[i].product);
+            }
+            *file << "\n";
+        }
+        if (events.empty()) {
+            if (stop) break;
+            file->flush();
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+    }
+    unsubscribeChanges(consumer);
+    file->close();
+    delete file;
+}
+
+bool startFeedLog(const string& filename) {
+    ofstream* file = new ofstream(filename, ios::trunc);
+    if (!*file) {
+        cerr << "Error: Could not open feed log '" << filename << "' for writing!\n";
+        delete file;
+        return false;
+    }
+    int consumer = subscribeChanges();
+    if (consumer < 0) {
+        cerr << "Error: No change feed consumer slot is free!\n";
+        delete file;
+        return false;
+    }
+    feedLog.stopping.store(false);
+    feedLog.worker = thread(runFeedLog, file, consumer);
+    return true;
+}
+
+// ========== LOW STOCK ALERTS ==========
+// Indexed min-heap over (stock - reorderThreshold). Each hash node knows its
+// heap position, so the mutation path can fix a product's key in O(log n),
+// and products below threshold are exactly the heap entries with a
+// negative key, found in O(k) by only descending into negative subtrees.
+
+vector<HashNode*> lowStockHeap;
+void (*lowStockCallback)(const Product& p) = NULL;
+
+int stockMargin(HashNode* node) {
+    return node->product.stock - node->product.reorderThreshold;
+}
+
+void swapHeapEntries(int a, int b) {
+    HashNode* temp = lowStockHeap[a];
+    lowStockHeap[a] = lowStockHeap[b];
+    lowStockHeap[b] = temp;
+    lowStockHeap[a]->heapIndex = a;
+    lowStockHeap[b]->heapIndex = b;
+}
+
+void siftUpHeap(int index) {
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (stockMargin(lowStockHeap[parent]) <= stockMargin(lowStockHeap[index])) break;
+        swapHeapEntries(parent, index);
+        index = parent;
+    }
+}
+
+void siftDownHeap(int index) {
+    int n = lowStockHeap.size();
+    while (true) {
+        int smallest = index;
+        int left = 2 * index + 1;
+        int right = 2 * index + 2;
+        if (left < n && stockMargin(lowStockHeap[left]) < stockMargin(lowStockHeap[smallest])) smallest = left;
+        if (right < n && stockMargin(lowStockHeap[right]) < stockMargin(lowStockHeap[smallest])) smallest = right;
+        if (smallest == index) break;
+        swapHeapEntries(index, smallest);
+        index = smallest;
+    }
+}
+
+// The callback fires when a product crosses below its threshold, not for
+// products that are added or loaded already below it.
+void notifyIfLowStock(HashNode* node, int oldMargin) {
+    if (lowStockCallback != NULL && oldMargin >= 0 && stockMargin(node) < 0) {
+        lowStockCallback(node->product);
+    }
+}
+
+void heapInsert(HashNode* node) {
+    node->heapIndex = lowStockHeap.size();
+    lowStockHeap.push_back(node);
+    siftUpHeap(node->heapIndex);
+}
+
+void heapRemove(HashNode* node) {
+    int index = node->heapIndex;
+    int last = lowStockHeap.size() - 1;
+    if (index < 0 || index > last) return;
     
-    HashNode* newNode = new HashNode;
-    newNode->product = p;
-    newNode->next = hashTable[index];
-    hashTable[index] = newNode;
+    if (index != last) {
+        swapHeapEntries(index, last);
+    }
+    lowStockHeap.pop_back();
+    node->heapIndex = -1;
     
-    bstRoot = insertBST(bstRoot, p);
+    if (index < last) {
+        HashNode* moved = lowStockHeap[index];
+        siftUpHeap(index);
+        siftDownHeap(moved->heapIndex);
+    }
+}
+
+// Call after node's stock or threshold changed; oldMargin is the key before.
+void heapUpdate(HashNode* node, int oldMargin) {
+    if (node->heapIndex < 0) return;
+    if (stockMargin(node) < oldMargin) {
+        siftUpHeap(node->heapIndex);
+    } else {
+        siftDownHeap(node->heapIndex);
+    }
+    notifyIfLowStock(node, oldMargin);
+}
+
+void collectLowStock(int index, vector<Product>& out) {
+    if (index >= (int)lowStockHeap.size() || stockMargin(lowStockHeap[index]) >= 0) return;
+    out.push_back(lowStockHeap[index]->product);
+    collectLowStock(2 * index + 1, out);
+    collectLowStock(2 * index + 2, out);
+}
+
+// All products whose stock is below their reorder threshold, in heap order.
+void lowStockProducts(vector<Product>& out) {
+    out.clear();
+    collectLowStock(0, out);
+}
+
+void setLowStockCallback(void (*callback)(const Product& p)) {
+    lowStockCallback = callback;
+}
+
+void freeBST(BSTNode* root) {
+    if (root == NULL) return;
+    freeBST(root->left);
+    freeBST(root->right);
+    delete root;
+}
+
+void freeStack(StackNode* stack) {
+    while (stack != NULL) {
+        StackNode* next = stack->next;
+        delete stack;
+        stack = next;
+    }
+}
+
+// ========== SALES HISTORY ==========
+// Each product keeps an append-only history of (time, units sold, stock
+// level) events, so questions like "units sold in the last 7 days" can be
+// answered. Recent events are stored in chunks of three byte columns:
+// time deltas, sales deltas and stock deltas, each as (zigzag) varints.
+// Older chunks are downsampled into hourly and then daily buckets, and the
+// oldest days are dropped, so memory per product stays bounded. Windows
+// reaching into downsampled data are as precise as the bucket size.
+
+const int SERIES_CHUNK_EVENTS = 128;
+const int MAX_RAW_CHUNKS = 2;
+const int MAX_HOURLY_BUCKETS = 7 * 24;
+const int MAX_DAILY_BUCKETS = 90;
+const long long SECONDS_PER_HOUR = 3600;
+const long long SECONDS_PER_DAY = 86400;
+
+struct SeriesChunk {
+    long long startTime;
+    long long endTime;
+    int firstStock;
+    int lastStock;
+    int count;
+    long long salesSum;
+    vector<unsigned char> times;   // seconds since the previous event
+    vector<unsigned char> sales;   // units sold by this event
+    vector<unsigned char> stocks;  // stock change since the previous event
+};
+
+struct SeriesBucket {
+    long long start;
+    long long sales;
+    int stock;  // stock level at the end of the bucket
+};
+
+struct SalesSeries {
+    vector<SeriesChunk> chunks;  // oldest first
+    deque<SeriesBucket> hourly;
+    deque<SeriesBucket> daily;
+};
+
+struct MoverEntry {
+    string id;
+    string name;
+    long long sold;
+    long long previous;  // units sold in the window before
+};
+
+long long currentTimeSeconds() {
+    return chrono::duration_cast<chrono::seconds>(
+               chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void appendVarint(vector<unsigned char>& column, unsigned long long value) {
+    while (value >= 0x80) {
+        column.push_back((unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    column.push_back((unsigned char)value);
+}
+
+unsigned long long takeVarint(const vector<unsigned char>& column, size_t& pos) {
+    unsigned long long value = 0;
+    for (int shift = 0; pos < column.size(); shift += 7) {
+        unsigned char byte = column[pos++];
+        value |= (unsigned long long)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) break;
+    }
+    return value;
+}
+
+unsigned long long zigzag(long long value) {
+    return ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63);
+}
+
+long long unzigzag(unsigned long long value) {
+    return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+// Walks a chunk's events in order; call next() until it returns false.
+struct ChunkReader {
+    const SeriesChunk& chunk;
+    size_t timePos, salesPos, stockPos;
+    int index;
+    long long time;
+    long long sales;
+    int stock;
     
-    Product empty;
-    empty.id = "";
-    pushStack(undoStack, "ADD", p, empty);
+    ChunkReader(const SeriesChunk& c)
+        : chunk(c), timePos(0), salesPos(0), stockPos(0), index(0),
+          time(c.startTime), sales(0), stock(c.firstStock) {}
     
-    cout << "Product added successfully!\n";
+    bool next() {
+        if (index >= chunk.count) return false;
+        time += takeVarint(chunk.times, timePos);
+        sales = unzigzag(takeVarint(chunk.sales, salesPos));
+        stock += unzigzag(takeVarint(chunk.stocks, stockPos));
+        index++;
+        return true;
+    }
+};
+
+void addToBuckets(deque<SeriesBucket>& buckets, long long start, long long sales, int stock) {
+    if (!buckets.empty() && buckets.back().start == start) {
+        buckets.back().sales += sales;
+        buckets.back().stock = stock;
+    } else {
+        SeriesBucket bucket;
+        bucket.start = start;
+        bucket.sales = sales;
+        bucket.stock = stock;
+        buckets.push_back(bucket);
+    }
 }
 
-Product* searchProduct(string id) {
-    if (!isValidProductID(id)) {
-        cout << "Error: Invalid Product ID format!\n";
-        return NULL;
+void downsampleOldestChunk(SalesSeries& series) {
+    ChunkReader reader(series.chunks.front());
+    while (reader.next()) {
+        addToBuckets(series.hourly, reader.time - reader.time % SECONDS_PER_HOUR, reader.sales, reader.stock);
     }
+    series.chunks.erase(series.chunks.begin());
     
-    int index = hashFunction(id);
-    HashNode* current = hashTable[index];
-    
-    while (current != NULL) {
-        if (current->product.id == id) {
-            return &current->product;
-        }
-        current = current->next;
+    while ((int)series.hourly.size() > MAX_HOURLY_BUCKETS) {
+        SeriesBucket& oldest = series.hourly.front();
+        addToBuckets(series.daily, oldest.start - oldest.start % SECONDS_PER_DAY, oldest.sales, oldest.stock);
+        series.hourly.pop_front();
+    }
+    while ((int)series.daily.size() > MAX_DAILY_BUCKETS) {
+        series.daily.pop_front();
     }
-    return NULL;
 }
 
-void updateProduct(string id, Product newProduct) {
-    if (!isValidProductID(id)) {
-        cout << "Error: Invalid Product ID!\n";
-        return;
+void appendSalesEvent(SalesSeries& series, long long time, long long sales, int stock) {
+    if (series.chunks.empty() || series.chunks.back().count == SERIES_CHUNK_EVENTS) {
+        SeriesChunk chunk;
+        chunk.startTime = time;
+        chunk.endTime = time;
+        chunk.firstStock = stock;
+        chunk.lastStock = stock;
+        chunk.count = 0;
+        chunk.salesSum = 0;
+        series.chunks.push_back(chunk);
     }
     
-    Product* oldProduct = searchProduct(id);
-    if (oldProduct == NULL) {
-        cout << "Product not found!\n";
-        return;
+    SeriesChunk& chunk = series.chunks.back();
+    // The clock may step backwards; keep the series ordered.
+    if (time < chunk.endTime) time = chunk.endTime;
+    appendVarint(chunk.times, time - chunk.endTime);
+    appendVarint(chunk.sales, zigzag(sales));
+    appendVarint(chunk.stocks, zigzag((long long)stock - chunk.lastStock));
+    chunk.endTime = time;
+    chunk.lastStock = stock;
+    chunk.salesSum += sales;
+    chunk.count++;
+    
+    if ((int)series.chunks.size() > MAX_RAW_CHUNKS) {
+        downsampleOldestChunk(series);
     }
+}
+
+void recordSalesEvent(HashNode* node, long long sales) {
+    if (node->series == NULL) node->series = new SalesSeries;
+    appendSalesEvent(*node->series, currentTimeSeconds(), sales, node->product.stock);
+}
+
+// Units sold with timestamps in [from, to).
+long long salesBetween(const SalesSeries* series, long long from, long long to) {
+    if (series == NULL) return 0;
+    long long total = 0;
     
-    if (!isValidProductName(newProduct.name)) {
-        cout << "Error: Product name cannot be empty!\n";
-        return;
+    for (size_t i = 0; i < series->daily.size(); i++) {
+        if (series->daily[i].start >= from && series->daily[i].start < to) total += series->daily[i].sales;
     }
+    for (size_t i = 0; i < series->hourly.size(); i++) {
+        if (series->hourly[i].start >= from && series->hourly[i].start < to) total += series->hourly[i].sales;
+    }
+    for (size_t i = 0; i < series->chunks.size(); i++) {
+        const SeriesChunk& chunk = series->chunks[i];
+        if (chunk.endTime < from || chunk.startTime >= to) continue;
+        if (chunk.startTime >= from && chunk.endTime < to) {
+            total += chunk.salesSum;
+            continue;
+        }
+        ChunkReader reader(chunk);
+        while (reader.next()) {
+            if (reader.time >= from && reader.time < to) total += reader.sales;
+        }
+    }
+    return total;
+}
+
+// Stock level at the given time, or -1 if the history does not go back that far.
+// Within downsampled history it is the level at the end of the hour or day.
+// A product whose stock never changed has had its current stock throughout.
+int stockAt(HashNode* node, long long time) {
+    const SalesSeries* series = node->series;
+    if (series == NULL) return node->product.stock;
+    int stock = -1;
+    
+    for (size_t i = 0; i < series->daily.size() && series->daily[i].start <= time; i++) {
+        stock = series->daily[i].stock;
+    }
+    for (size_t i = 0; i < series->hourly.size() && series->hourly[i].start <= time; i++) {
+        stock = series->hourly[i].stock;
+    }
+    for (size_t i = 0; i < series->chunks.size() && series->chunks[i].startTime <= time; i++) {
+        ChunkReader reader(series->chunks[i]);
+        while (reader.next() && reader.time <= time) {
+            stock = reader.stock;
+        }
+    }
+    return stock;
+}
+
+long long unitsSold(HashNode* node, long long windowSeconds) {
+    long long now = currentTimeSeconds();
+    return salesBetween(node->series, now - windowSeconds, now + 1);
+}
+
+// Average units sold per day over the window.
+double salesRate(HashNode* node, long long windowSeconds) {
+    if (windowSeconds <= 0) return 0;
+    return unitsSold(node, windowSeconds) * (double)SECONDS_PER_DAY / windowSeconds;
+}
+
+// The k products that sold the most in the last windowSeconds, with their
+// sales in the window before for comparison.
+void topMovers(int k, long long windowSeconds, vector<MoverEntry>& out) {
+    out.clear();
+    long long now = currentTimeSeconds() + 1;
+    
+    for (int i = 0; i < 100; i++) {
+        for (HashNode* current = hashTable[i]; current != NULL; current = current->next) {
+            long long sold = salesBetween(current->series, now - windowSeconds, now);
+            if (sold <= 0) continue;
+            MoverEntry entry;
+            entry.id = current->product.id;
+            entry.name = current->product.name;
+            entry.sold = sold;
+            entry.previous = salesBetween(current->series, now - 2 * windowSeconds, now - windowSeconds);
+            out.push_back(entry);
+        }
+    }
+    
+    if (k > (int)out.size()) k = out.size();
+    partial_sort(out.begin(), out.begin() + k, out.end(),
+                 [](const MoverEntry& a, const MoverEntry& b) { return a.sold > b.sold; });
+    out.resize(k);
+}
+
+void freeHashNode(HashNode* node) {
+    delete node->series;
+    delete node->locations;
+    delete node;
+}
+
+// ========== WAREHOUSE LOCATIONS ==========
+// Product::stock is the total across warehouses; the split by location is
+// a sparse list per product, sorted by location index. A product with no
+// list holds all of its stock at the default location (index 0), which
+// keeps single-warehouse catalogs free of per-product overhead. Units and
+// stock value per location are kept up to date with every change, so
+// warehouse totals are O(1). Stock changes that do not name a location
+// are received into the default location and sold from the locations in
+// registration order, default first.
+
+struct LocationStock {
+    int location;
+    int quantity;
+};
+
+const int MAX_LOCATIONS = 1024;
+
+vector<string> locationNames(1, "MAIN");
+map<string, int> locationIndex = {{"MAIN", 0}};
+vector<long long> locationUnits(1, 0);
+vector<Money> locationValue(1, 0);
+
+int findLocation(const string& name) {
+    map<string, int>::iterator it = locationIndex.find(name);
+    return it == locationIndex.end() ? -1 : it->second;
+}
+
+// Index of the named location, registering it on first use; -1 if the
+// name is invalid or there are already MAX_LOCATIONS locations.
+int registerLocation(const string& name) {
+    int location = findLocation(name);
+    if (location >= 0) return location;
+    if (!isValidLocationName(name) || (int)locationNames.size() >= MAX_LOCATIONS) return -1;
+    
+    location = locationNames.size();
+    locationNames.push_back(name);
+    locationIndex[name] = location;
+    locationUnits.push_back(0);
+    locationValue.push_back(0);
+    return location;
+}
+
+int locationQuantity(HashNode* node, int location) {
+    if (node->locations == NULL) return location == 0 ? node->product.stock : 0;
+    for (size_t i = 0; i < node->locations->size(); i++) {
+        if ((*node->locations)[i].location == location) return (*node->locations)[i].quantity;
+    }
+    return 0;
+}
+
+// Gives the product an explicit list, without changing any totals.
+void materializeLocations(HashNode* node) {
+    if (node->locations != NULL) return;
+    node->locations = new vector<LocationStock>();
+    if (node->product.stock > 0) node->locations->push_back({0, node->product.stock});
+}
+
+// Drops the explicit list again when everything is at the default location.
+void collapseLocations(HashNode* node) {
+    vector<LocationStock>* entries = node->locations;
+    if (entries != NULL && (entries->empty() || (entries->size() == 1 && (*entries)[0].location == 0))) {
+        delete entries;
+        node->locations = NULL;
+    }
+}
+
+void adjustLocation(HashNode* node, int location, int delta, Money price) {
+    node->rowHash = 0;
+    vector<LocationStock>& entries = *node->locations;
+    size_t i = 0;
+    while (i < entries.size() && entries[i].location < location) i++;
+    if (i == entries.size() || entries[i].location != location) {
+        entries.insert(entries.begin() + i, LocationStock{location, 0});
+    }
+    
+    entries[i].quantity += delta;
+    locationUnits[location] += delta;
+    locationValue[location] += (Money)delta * price;
+    if (entries[i].quantity == 0) entries.erase(entries.begin() + i);
+}
+
+void addToLocations(HashNode* node) {
+    locationUnits[0] += node->product.stock;
+    locationValue[0] += (Money)node->product.stock * node->product.price;
+}
+
+void removeFromLocations(HashNode* node) {
+    if (node->locations == NULL) {
+        locationUnits[0] -= node->product.stock;
+        locationValue[0] -= (Money)node->product.stock * node->product.price;
+        return;
+    }
+    
+    vector<LocationStock>& entries = *node->locations;
+    for (size_t i = 0; i < entries.size(); i++) {
+        locationUnits[entries[i].location] -= entries[i].quantity;
+        locationValue[entries[i].location] -= (Money)entries[i].quantity * node->product.price;
+    }
+    delete node->locations;
+    node->locations = NULL;
+}
+
+// Call after item->product changed; old holds the previous values. The
+// list may already add up to the new stock (a location was set directly);
+// otherwise the difference goes to or comes from the default locations.
+void updateLocations(HashNode* node, const Product& old) {
+    const Product& p = node->product;
+    if (node->locations == NULL) {
+        locationUnits[0] += p.stock - old.stock;
+        locationValue[0] += (Money)p.stock * p.price - (Money)old.stock * old.price;
+        return;
+    }
+    
+    vector<LocationStock>& entries = *node->locations;
+    int placed = 0;
+    for (size_t i = 0; i < entries.size(); i++) {
+        locationValue[entries[i].location] += (Money)entries[i].quantity * (p.price - old.price);
+        placed += entries[i].quantity;
+    }
+    
+    int difference = p.stock - placed;
+    if (difference > 0) adjustLocation(node, 0, difference, p.price);
+    while (difference < 0 && !entries.empty()) {
+        int taken = min(-difference, entries[0].quantity);
+        adjustLocation(node, entries[0].location, -taken, p.price);
+        difference += taken;
+    }
+    collapseLocations(node);
+}
+
+void recordVersion(HashNode* node);  // see SNAPSHOTS
+
+// Replaces the product's split; the quantities must add up to its stock.
+void assignLocations(HashNode* node, const vector<LocationStock>& split) {
+    TraceScope trace(TRACE_LOCATIONS);
+    if (trace.active) {
+        string text;
+        for (size_t i = 0; i < split.size(); i++) {
+            if (i > 0) text += ";";
+            text += locationNames[split[i].location] + ":" + to_string(split[i].quantity);
+        }
+        writeTraceString(node->product.id);
+        writeTraceString(text);
+    }
+    
+    removeFromLocations(node);
+    node->locations = new vector<LocationStock>();
+    for (size_t i = 0; i < split.size(); i++) {
+        if (split[i].quantity > 0) adjustLocation(node, split[i].location, split[i].quantity, node->product.price);
+    }
+    collapseLocations(node);
+    recordVersion(node);
+}
+
+string formatLocations(HashNode* node) {
+    string text;
+    vector<LocationStock>& entries = *node->locations;
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (i > 0) text += ";";
+        text += locationNames[entries[i].location] + ":" + to_string(entries[i].quantity);
+    }
+    return text;
+}
+
+// ========== SNAPSHOTS ==========
+// Versioned product records, so a save or a long report can read the
+// catalog as of one moment on a background thread while the owning thread
+// keeps changing it. Every resident product has a slot holding a chain of
+// versions, newest first, each stamped with the catalog version that wrote
+// it. A snapshot taken at version V sees, per slot, the newest version no
+// later than V; a deleted (or evicted) product leaves a tombstone version.
+//
+// Snapshots are opened on the owning thread and may be read and closed on
+// any thread. While none is open there is nothing to keep, so changes
+// overwrite the single version in place. Otherwise each change prepends a
+// version, and versions no open snapshot can see are unlinked and freed by
+// epoch: an unlinked version is only freed once every snapshot that was
+// open when it was unlinked has been closed, since a reader may still be
+// holding it.
+
+const int VERSION_CHUNK_BITS = 12;
+const int VERSION_CHUNK_SIZE = 1 << VERSION_CHUNK_BITS;
+const int MAX_VERSION_CHUNKS = 1 << 16;
+const int MAX_SNAPSHOTS = 4;
+
+struct ProductVersion {
+    Product product;
+    string locations;        // warehouse column, empty when all at the default location
+    long long version;       // catalog version that wrote it
+    bool deleted;            // tombstone: the product was deleted or evicted
+    ProductVersion* older;
+};
+
+struct VersionSlot {
+    atomic<ProductVersion*> head;
+    bool pending;            // has versions to trim (on pendingVersionSlots)
+};
+
+struct SnapshotReader {
+    atomic<bool> active;
+    long long version;       // catalog version the snapshot reads
+    long long epoch;         // reclaimEpoch when it was opened
+};
+
+struct Snapshot {
+    int reader;
+    long long version;
+    int slots;               // slots that existed when it was opened
+};
+
+struct RetiredVersion {
+    ProductVersion* version; // unlinked chain, freed as a whole
+    long long epoch;
+};
+
+VersionSlot* versionChunks[MAX_VERSION_CHUNKS];
+int versionSlotCount = 0;
+vector<int> freeVersionSlots;
+vector<int> pendingVersionSlots;
+vector<RetiredVersion> retiredVersions;
+SnapshotReader snapshotReaders[MAX_SNAPSHOTS];
+atomic<int> snapshotsClosed(0);
+int snapshotsClosedSeen = 0;
+long long catalogVersion = 0;
+long long reclaimEpoch = 0;
+long long liveVersions = 0;
+
+VersionSlot& versionSlot(int slot) {
+    return versionChunks[slot >> VERSION_CHUNK_BITS][slot & (VERSION_CHUNK_SIZE - 1)];
+}
+
+// Catalog version and epoch of the oldest open snapshot; false if none.
+bool oldestSnapshot(long long& version, long long& epoch) {
+    bool open = false;
+    version = LLONG_MAX;
+    epoch = LLONG_MAX;
+    for (int i = 0; i < MAX_SNAPSHOTS; i++) {
+        if (snapshotReaders[i].active.load(memory_order_acquire)) {
+            version = min(version, snapshotReaders[i].version);
+            epoch = min(epoch, snapshotReaders[i].epoch);
+            open = true;
+        }
+    }
+    return open;
+}
+
+void freeVersionChain(ProductVersion* version) {
+    while (version != NULL) {
+        ProductVersion* older = version->older;
+        delete version;
+        liveVersions--;
+        version = older;
+    }
+}
+
+void retireVersionChain(ProductVersion* version, bool open) {
+    if (version == NULL) return;
+    if (open) retiredVersions.push_back({version, reclaimEpoch});
+    else freeVersionChain(version);
+}
+
+// Drops the versions of pending slots that no open snapshot can see, and
+// frees unlinked versions no open snapshot can still be reading.
+void reclaimVersions() {
+    snapshotsClosedSeen = snapshotsClosed.load(memory_order_acquire);
+    long long oldestVersion, oldestEpoch;
+    bool open = oldestSnapshot(oldestVersion, oldestEpoch);
+    
+    size_t kept = 0;
+    for (size_t i = 0; i < retiredVersions.size(); i++) {
+        if (retiredVersions[i].epoch < oldestEpoch) freeVersionChain(retiredVersions[i].version);
+        else retiredVersions[kept++] = retiredVersions[i];
+    }
+    retiredVersions.resize(kept);
+    
+    kept = 0;
+    for (size_t i = 0; i < pendingVersionSlots.size(); i++) {
+        int slot = pendingVersionSlots[i];
+        VersionSlot& entry = versionSlot(slot);
+        ProductVersion* head = entry.head.load(memory_order_relaxed);
+        ProductVersion* visible = head;
+        while (visible != NULL && visible->version > oldestVersion) visible = visible->older;
+        
+        if (visible != NULL) {
+            retireVersionChain(visible->older, open);
+            visible->older = NULL;
+            if (visible == head && head->deleted) {
+                entry.head.store(NULL, memory_order_release);
+                retireVersionChain(head, open);
+                freeVersionSlots.push_back(slot);
+                entry.pending = false;
+                continue;
+            }
+        }
+        if (visible == head) {
+            entry.pending = false;
+        } else {
+            pendingVersionSlots[kept++] = slot;
+        }
+    }
+    pendingVersionSlots.resize(kept);
+}
+
+// Cheap enough for every change: only does work once a snapshot was closed.
+void maybeReclaimVersions() {
+    if (pendingVersionSlots.empty() && retiredVersions.empty()) return;
+    if (snapshotsClosed.load(memory_order_acquire) != snapshotsClosedSeen) reclaimVersions();
+}
+
+int allocateVersionSlot() {
+    int slot;
+    if (!freeVersionSlots.empty()) {
+        slot = freeVersionSlots.back();
+        freeVersionSlots.pop_back();
+        return slot;
+    }
+    slot = versionSlotCount;
+    if ((slot >> VERSION_CHUNK_BITS) >= MAX_VERSION_CHUNKS) throw bad_alloc();
+    if ((slot & (VERSION_CHUNK_SIZE - 1)) == 0) {
+        VersionSlot* chunk = new VersionSlot[VERSION_CHUNK_SIZE];
+        for (int i = 0; i < VERSION_CHUNK_SIZE; i++) {
+            chunk[i].head.store(NULL, memory_order_relaxed);
+            chunk[i].pending = false;
+        }
+        versionChunks[slot >> VERSION_CHUNK_BITS] = chunk;
+    }
+    versionSlotCount++;
+    return slot;
+}
+
+void prependVersion(int slot, ProductVersion* version) {
+    VersionSlot& entry = versionSlot(slot);
+    version->older = entry.head.load(memory_order_relaxed);
+    entry.head.store(version, memory_order_release);
+    liveVersions++;
+    if (!entry.pending && version->older != NULL) {
+        entry.pending = true;
+        pendingVersionSlots.push_back(slot);
+    }
+}
+
+// Call after any change to the product or its location split.
+void recordVersion(HashNode* node) {
+    maybeReclaimVersions();
+    long long oldestVersion, oldestEpoch;
+    bool open = oldestSnapshot(oldestVersion, oldestEpoch);
+    if (node->versionSlot < 0) node->versionSlot = allocateVersionSlot();
+    
+    ProductVersion* head = versionSlot(node->versionSlot).head.load(memory_order_relaxed);
+    ProductVersion* version = head;
+    if (open || head == NULL) version = new ProductVersion;
+    version->product = node->product;
+    version->locations = node->locations != NULL ? formatLocations(node) : string();
+    version->version = ++catalogVersion;
+    version->deleted = false;
+    if (version != head) prependVersion(node->versionSlot, version);
+}
+
+// Call before the node is freed (deleted, evicted or the catalog cleared).
+void retireVersion(HashNode* node) {
+    if (node->versionSlot < 0) return;
+    maybeReclaimVersions();
+    long long oldestVersion, oldestEpoch;
+    VersionSlot& entry = versionSlot(node->versionSlot);
+    bool open = oldestSnapshot(oldestVersion, oldestEpoch);
+    
+    // A snapshot that closed since the check above leaves the slot pending;
+    // with none open, trimming it now clears that.
+    if (!open && entry.pending) reclaimVersions();
+    if (!open) {
+        freeVersionChain(entry.head.load(memory_order_relaxed));
+        entry.head.store(NULL, memory_order_relaxed);
+        freeVersionSlots.push_back(node->versionSlot);
+    } else {
+        ProductVersion* tombstone = new ProductVersion;
+        tombstone->product.id = node->product.id;
+        tombstone->version = ++catalogVersion;
+        tombstone->deleted = true;
+        prependVersion(node->versionSlot, tombstone);
+    }
+    node->versionSlot = -1;
+}
+
+// Opens a snapshot of the catalog as it is now. Owning thread only; false
+// if MAX_SNAPSHOTS are already open.
+bool beginSnapshot(Snapshot& snapshot) {
+    maybeReclaimVersions();
+    for (int i = 0; i < MAX_SNAPSHOTS; i++) {
+        if (snapshotReaders[i].active.load(memory_order_acquire)) continue;
+        snapshotReaders[i].version = catalogVersion;
+        snapshotReaders[i].epoch = ++reclaimEpoch;
+        snapshotReaders[i].active.store(true, memory_order_release);
+        snapshot.reader = i;
+        snapshot.version = catalogVersion;
+        snapshot.slots = versionSlotCount;
+        return true;
+    }
+    return false;
+}
+
+// The slot's product as of the snapshot, or NULL if there was none.
+const ProductVersion* snapshotVersion(const Snapshot& snapshot, int slot) {
+    const ProductVersion* version = versionSlot(slot).head.load(memory_order_acquire);
+    while (version != NULL && version->version > snapshot.version) version = version->older;
+    return version != NULL && !version->deleted ? version : NULL;
+}
+
+void endSnapshot(Snapshot& snapshot) {
+    snapshotReaders[snapshot.reader].active.store(false, memory_order_release);
+    snapshotsClosed.fetch_add(1, memory_order_release);
+}
+
+// ========== SORTED VIEWS ==========
+// Price, rating and sales orderings kept up to date by the mutation
+// functions, so "rank of product X" and "page 37 of 50" do not need a full
+// sort. Each view is a treap (randomised balanced BST) whose nodes know
+// their subtree size, which gives O(log n) rank and select and
+// O(log n + k) for k consecutive ranks. Equal values are ordered by
+// product key so every product has a distinct position. Evicted products
+// stay in the views, keyed by the ID stored in the node, so ranks do not
+// change when the cold tier pages products out.
+
+struct ViewNode {
+    long long value;
+    ProductKey key;
+    string id;
+    HashNode* item;  // NULL while the product is in the cold store
+    unsigned int priority;
+    int size;
+    ViewNode* left;
+    ViewNode* right;
+};
+
+const int VIEW_COUNT = 3;  // indexed by sortBy - 1: price, rating, sales
+ViewNode* sortedViews[VIEW_COUNT];
+unsigned long long viewRandomState = 0x2545F4914F6CDD1DULL;
+
+// All three fields mapped to integers that sort the same way. Ratings are
+// non-negative doubles, whose IEEE bit patterns already sort like integers.
+long long viewValue(int view, const Product& p) {
+    if (view == 0) return p.price;
+    if (view == 2) return p.sales;
+    double rating = p.rating == 0.0 ? 0.0 : p.rating;
+    long long bits;
+    memcpy(&bits, &rating, sizeof(bits));
+    return bits;
+}
+
+int compareViewEntries(long long value, const ProductKey& key, const string& id, ViewNode* node) {
+    if (value != node->value) return value < node->value ? -1 : 1;
+    if (key.words[0] != node->key.words[0]) return key.words[0] < node->key.words[0] ? -1 : 1;
+    if (key.words[1] != node->key.words[1]) return key.words[1] < node->key.words[1] ? -1 : 1;
+    return id.compare(node->id);
+}
+
+int viewSize(ViewNode* node) {
+    return node == NULL ? 0 : node->size;
+}
+
+void updateViewSize(ViewNode* node) {
+    node->size = 1 + viewSize(node->left) + viewSize(node->right);
+}
+
+ViewNode* rotateViewRight(ViewNode* node) {
+    ViewNode* child = node->left;
+    node->left = child->right;
+    child->right = node;
+    updateViewSize(node);
+    updateViewSize(child);
+    return child;
+}
+
+ViewNode* rotateViewLeft(ViewNode* node) {
+    ViewNode* child = node->right;
+    node->right = child->left;
+    child->left = node;
+    updateViewSize(node);
+    updateViewSize(child);
+    return child;
+}
+
+ViewNode* viewInsert(ViewNode* root, long long value, HashNode* item) {
+    if (root == NULL) {
+        ViewNode* node = new ViewNode;
+        node->value = value;
+        node->key = item->key;
+        node->id = item->product.id;
+        node->item = item;
+        viewRandomState ^= viewRandomState << 13;
+        viewRandomState ^= viewRandomState >> 7;
+        viewRandomState ^= viewRandomState << 17;
+        node->priority = (unsigned int)viewRandomState;
+        node->size = 1;
+        node->left = NULL;
+        node->right = NULL;
+        return node;
+    }
+    
+    if (compareViewEntries(value, item->key, item->product.id, root) < 0) {
+        root->left = viewInsert(root->left, value, item);
+        if (root->left->priority > root->priority) root = rotateViewRight(root);
+    } else {
+        root->right = viewInsert(root->right, value, item);
+        if (root->right->priority > root->priority) root = rotateViewLeft(root);
+    }
+    updateViewSize(root);
+    return root;
+}
+
+ViewNode* viewErase(ViewNode* root, long long value, HashNode* item) {
+    if (root == NULL) return NULL;
+    
+    int cmp = compareViewEntries(value, item->key, item->product.id, root);
+    if (cmp < 0) {
+        root->left = viewErase(root->left, value, item);
+    } else if (cmp > 0) {
+        root->right = viewErase(root->right, value, item);
+    } else if (root->left == NULL || root->right == NULL) {
+        ViewNode* child = root->left != NULL ? root->left : root->right;
+        delete root;
+        return child;
+    } else {
+        // Rotate the node down until it has at most one child.
+        if (root->left->priority > root->right->priority) {
+            root = rotateViewRight(root);
+            root->right = viewErase(root->right, value, item);
+        } else {
+            root = rotateViewLeft(root);
+            root->left = viewErase(root->left, value, item);
+        }
+    }
+    updateViewSize(root);
+    return root;
+}
+
+ViewNode* viewFind(ViewNode* root, long long value, const ProductKey& key, const string& id) {
+    while (root != NULL) {
+        int cmp = compareViewEntries(value, key, id, root);
+        if (cmp == 0) return root;
+        root = cmp < 0 ? root->left : root->right;
+    }
+    return NULL;
+}
+
+void freeView(ViewNode* root) {
+    if (root == NULL) return;
+    freeView(root->left);
+    freeView(root->right);
+    delete root;
+}
+
+void addToViews(HashNode* item) {
+    for (int view = 0; view < VIEW_COUNT; view++) {
+        sortedViews[view] = viewInsert(sortedViews[view], viewValue(view, item->product), item);
+    }
+}
+
+void removeFromViews(HashNode* item) {
+    for (int view = 0; view < VIEW_COUNT; view++) {
+        sortedViews[view] = viewErase(sortedViews[view], viewValue(view, item->product), item);
+    }
+}
+
+// Points the product's view entries at item, or at NULL when it is
+// evicted. The entries keep their place, since a cold product's values
+// cannot change until it is paged back in.
+void setViewItem(const Product& p, HashNode* item) {
+    ProductKey key = makeProductKey(p.id);
+    for (int view = 0; view < VIEW_COUNT; view++) {
+        ViewNode* entry = viewFind(sortedViews[view], viewValue(view, p), key, p.id);
+        if (entry != NULL) entry->item = item;
+    }
+}
+
+// Call after item->product changed; old holds the previous values.
+void updateViews(HashNode* item, const Product& old) {
+    for (int view = 0; view < VIEW_COUNT; view++) {
+        long long oldValue = viewValue(view, old);
+        long long newValue = viewValue(view, item->product);
+        if (oldValue == newValue) continue;
+        sortedViews[view] = viewErase(sortedViews[view], oldValue, item);
+        sortedViews[view] = viewInsert(sortedViews[view], newValue, item);
+    }
+}
+
+// ========== COLD STORAGE ==========
+// Optional second tier for catalogs larger than memory. Quiet products are
+// evicted from every in-memory index into a B+-tree of their CSV rows,
+// keyed by ID, in a scratch file, and paged back in by findHashNode the
+// next time they are touched. Pages go through a CLOCK cache of
+// configurable size, and a Bloom filter answers most lookups of IDs that
+// are not on disk without reading a page. The file only lives for the
+// session; saveToFile is still how the catalog is persisted.
+//
+// Leaf pages hold records (row length, merge stamp, row hash, row) sorted
+// by ID and are chained for scans. Internal pages hold up to COLD_MAX_KEYS
+// separator IDs. Deletes do not rebalance; an emptied leaf stays linked.
+
+const int COLD_PAGE_SIZE = 4096;
+const int COLD_MAX_KEY = 64;        // products with longer IDs stay in memory
+const int COLD_MAX_ROW = 1024;      // and so do products with longer rows
+const int COLD_LEAF_HEADER = 8;     // type, count, next leaf
+const int COLD_RECORD_HEADER = 14;  // row length, merge stamp, row hash
+const int COLD_MAX_KEYS = (COLD_PAGE_SIZE - 12) / (4 + 1 + COLD_MAX_KEY);
+const char COLD_LEAF = 1;
+const char COLD_INTERNAL = 2;
+const int BLOOM_BITS_PER_KEY = 10;
+const int BLOOM_HASHES = 7;
+
+struct ColdRecord {
+    string row;
+    unsigned int stamp;             // mergeStamp of the evicted product
+    unsigned long long rowHash;     // its rowHash
+};
+
+struct ColdLeaf {
+    unsigned int next;
+    vector<ColdRecord> records;
+};
+
+struct ColdInternal {
+    vector<string> keys;            // child i holds IDs in [keys[i-1], keys[i])
+    vector<unsigned int> children;
+};
+
+struct CacheFrame {
+    unsigned int page;
+    bool dirty;
+    bool referenced;
+    char data[COLD_PAGE_SIZE];
+};
+
+struct ColdStore {
+    bool enabled;
+    fstream file;
+    unsigned int root;              // 0 while the tree is empty
+    unsigned int pageCount;         // page 0 is never used, so 0 means "none"
+    unsigned int pagesOnDisk;
+    long long rows;
+    int hotLimit;                   // products to keep in memory
+    int evictAfter;                 // backs off when nothing could be evicted
+    int evictBucket;                // CLOCK hand over the hash buckets
+    
+    size_t cacheCapacity;
+    vector<CacheFrame> frames;
+    map<unsigned int, int> frameOf;
+    size_t clockHand;
+    
+    vector<unsigned long long> bloom;
+    long long bloomCapacity;        // keys the filter was sized for
+    long long bloomAdded;           // keys added since it was built
+    
+    long long cacheHits, cacheMisses, pageReads, pageWrites;
+    long long bloomSkips, faults, evictions;
+};
+
+ColdStore coldStore;
+int residentProducts = 0;
+
+// Defined with the CSV code, since they read and write product rows.
+HashNode* faultInProduct(const string& id);
+bool readColdProduct(const string& id, Product& out);
+void evictColdProducts();
+void collectColdProducts(vector<Product>& out, Money minPrice = 0, Money maxPrice = LLONG_MAX);
+
+string coldRowId(const string& row) {
+    return row.substr(0, row.find(','));
+}
+
+void writeColdFrame(CacheFrame& frame) {
+    coldStore.file.seekp((streamoff)frame.page * COLD_PAGE_SIZE);
+    coldStore.file.write(frame.data, COLD_PAGE_SIZE);
+    coldStore.pageWrites++;
+    coldStore.pagesOnDisk = max(coldStore.pagesOnDisk, frame.page + 1);
+    frame.dirty = false;
+}
+
+// Cache slot holding the page, reading it in (and writing back the CLOCK
+// victim) on a miss.
+int coldFrame(unsigned int page) {
+    map<unsigned int, int>::iterator it = coldStore.frameOf.find(page);
+    if (it != coldStore.frameOf.end()) {
+        coldStore.frames[it->second].referenced = true;
+        coldStore.cacheHits++;
+        return it->second;
+    }
+    
+    coldStore.cacheMisses++;
+    int slot;
+    if (coldStore.frames.size() < coldStore.cacheCapacity) {
+        coldStore.frames.push_back(CacheFrame());
+        slot = coldStore.frames.size() - 1;
+    } else {
+        while (coldStore.frames[coldStore.clockHand].referenced) {
+            coldStore.frames[coldStore.clockHand].referenced = false;
+            coldStore.clockHand = (coldStore.clockHand + 1) % coldStore.frames.size();
+        }
+        slot = coldStore.clockHand;
+        coldStore.clockHand = (coldStore.clockHand + 1) % coldStore.frames.size();
+        if (coldStore.frames[slot].dirty) writeColdFrame(coldStore.frames[slot]);
+        coldStore.frameOf.erase(coldStore.frames[slot].page);
+    }
+    
+    CacheFrame& frame = coldStore.frames[slot];
+    frame.page = page;
+    frame.dirty = false;
+    frame.referenced = true;
+    if (page < coldStore.pagesOnDisk) {
+        coldStore.file.seekg((streamoff)page * COLD_PAGE_SIZE);
+        coldStore.file.read(frame.data, COLD_PAGE_SIZE);
+        coldStore.pageReads++;
+    } else {
+        memset(frame.data, 0, COLD_PAGE_SIZE);
+    }
+    coldStore.frameOf[page] = slot;
+    return slot;
+}
+
+void readColdPage(unsigned int page, char* data) {
+    memcpy(data, coldStore.frames[coldFrame(page)].data, COLD_PAGE_SIZE);
+}
+
+void writeColdPage(unsigned int page, const char* data) {
+    CacheFrame& frame = coldStore.frames[coldFrame(page)];
+    memcpy(frame.data, data, COLD_PAGE_SIZE);
+    frame.dirty = true;
+}
+
+int coldLeafBytes(const ColdLeaf& leaf) {
+    int bytes = COLD_LEAF_HEADER;
+    for (size_t i = 0; i < leaf.records.size(); i++) {
+        bytes += COLD_RECORD_HEADER + leaf.records[i].row.size();
+    }
+    return bytes;
+}
+
+void decodeColdLeaf(const char* data, ColdLeaf& leaf) {
+    unsigned short count;
+    memcpy(&count, data + 1, 2);
+    memcpy(&leaf.next, data + 4, 4);
+    leaf.records.resize(count);
+    
+    const char* p = data + COLD_LEAF_HEADER;
+    for (int i = 0; i < count; i++) {
+        unsigned short length;
+        memcpy(&length, p, 2);
+        memcpy(&leaf.records[i].stamp, p + 2, 4);
+        memcpy(&leaf.records[i].rowHash, p + 6, 8);
+        leaf.records[i].row.assign(p + COLD_RECORD_HEADER, length);
+        p += COLD_RECORD_HEADER + length;
+    }
+}
+
+void encodeColdLeaf(const ColdLeaf& leaf, char* data) {
+    memset(data, 0, COLD_PAGE_SIZE);
+    unsigned short count = leaf.records.size();
+    data[0] = COLD_LEAF;
+    memcpy(data + 1, &count, 2);
+    memcpy(data + 4, &leaf.next, 4);
+    
+    char* p = data + COLD_LEAF_HEADER;
+    for (size_t i = 0; i < leaf.records.size(); i++) {
+        unsigned short length = leaf.records[i].row.size();
+        memcpy(p, &length, 2);
+        memcpy(p + 2, &leaf.records[i].stamp, 4);
+        memcpy(p + 6, &leaf.records[i].rowHash, 8);
+        memcpy(p + COLD_RECORD_HEADER, leaf.records[i].row.data(), length);
+        p += COLD_RECORD_HEADER + length;
+    }
+}
+
+// Internal layout: type, key count, then the child page numbers, then the
+// keys as (length, COLD_MAX_KEY bytes).
+void decodeColdInternal(const char* data, ColdInternal& node) {
+    unsigned short count;
+    memcpy(&count, data + 1, 2);
+    node.children.resize(count + 1);
+    memcpy(&node.children[0], data + 8, 4 * (count + 1));
+    
+    const char* keys = data + 8 + 4 * (COLD_MAX_KEYS + 1);
+    node.keys.resize(count);
+    for (int i = 0; i < count; i++) {
+        const char* key = keys + i * (1 + COLD_MAX_KEY);
+        node.keys[i].assign(key + 1, (unsigned char)key[0]);
+    }
+}
+
+void encodeColdInternal(const ColdInternal& node, char* data) {
+    memset(data, 0, COLD_PAGE_SIZE);
+    unsigned short count = node.keys.size();
+    data[0] = COLD_INTERNAL;
+    memcpy(data + 1, &count, 2);
+    memcpy(data + 8, &node.children[0], 4 * (count + 1));
+    
+    char* keys = data + 8 + 4 * (COLD_MAX_KEYS + 1);
+    for (int i = 0; i < count; i++) {
+        char* key = keys + i * (1 + COLD_MAX_KEY);
+        key[0] = (char)node.keys[i].size();
+        memcpy(key + 1, node.keys[i].data(), node.keys[i].size());
+    }
+}
+
+size_t coldRecordPosition(const ColdLeaf& leaf, const string& id) {
+    size_t low = 0, high = leaf.records.size();
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (coldRowId(leaf.records[mid].row) < id) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+bool coldRecordAt(const ColdLeaf& leaf, size_t position, const string& id) {
+    return position < leaf.records.size() && coldRowId(leaf.records[position].row) == id;
+}
+
+// Leaf page that holds (or would hold) the ID.
+unsigned int coldLeafFor(const string& id) {
+    char data[COLD_PAGE_SIZE];
+    unsigned int page = coldStore.root;
+    while (true) {
+        readColdPage(page, data);
+        if (data[0] == COLD_LEAF) return page;
+        ColdInternal node;
+        decodeColdInternal(data, node);
+        page = node.children[upper_bound(node.keys.begin(), node.keys.end(), id) - node.keys.begin()];
+    }
+}
+
+unsigned int coldFirstLeaf() {
+    char data[COLD_PAGE_SIZE];
+    unsigned int page = coldStore.root;
+    while (page != 0) {
+        readColdPage(page, data);
+        if (data[0] == COLD_LEAF) return page;
+        ColdInternal node;
+        decodeColdInternal(data, node);
+        page = node.children[0];
+    }
+    return 0;
+}
+
+void readColdLeaf(unsigned int page, ColdLeaf& leaf) {
+    char data[COLD_PAGE_SIZE];
+    readColdPage(page, data);
+    decodeColdLeaf(data, leaf);
+}
+
+void bloomProbes(const string& id, unsigned long long& h1, unsigned long long& h2) {
+    h1 = 14695981039346656037ULL;
+    for (size_t i = 0; i < id.length(); i++) {
+        h1 = (h1 ^ (unsigned char)id[i]) * 1099511628211ULL;
+    }
+    h2 = ((h1 >> 29) ^ (h1 * 0x9E3779B97F4A7C15ULL)) | 1;
+}
+
+void bloomAdd(const string& id) {
+    unsigned long long h1, h2;
+    bloomProbes(id, h1, h2);
+    unsigned long long mask = coldStore.bloom.size() * 64 - 1;
+    for (int i = 0; i < BLOOM_HASHES; i++) {
+        unsigned long long bit = (h1 + i * h2) & mask;
+        coldStore.bloom[bit >> 6] |= 1ULL << (bit & 63);
+    }
+    coldStore.bloomAdded++;
+}
+
+bool bloomMayContain(const string& id) {
+    unsigned long long h1, h2;
+    bloomProbes(id, h1, h2);
+    unsigned long long mask = coldStore.bloom.size() * 64 - 1;
+    for (int i = 0; i < BLOOM_HASHES; i++) {
+        unsigned long long bit = (h1 + i * h2) & mask;
+        if ((coldStore.bloom[bit >> 6] & (1ULL << (bit & 63))) == 0) return false;
+    }
+    return true;
+}
+
+// Bits cannot be cleared, so the filter is rebuilt from the leaves, sized
+// for twice the current rows, once as many keys were added as it was
+// sized for. That also drops IDs that were paged back in.
+void rebuildBloom() {
+    coldStore.bloomCapacity = max(1024LL, coldStore.rows * 2);
+    unsigned long long words = 1;
+    while (words * 64 < (unsigned long long)coldStore.bloomCapacity * BLOOM_BITS_PER_KEY) words *= 2;
+    coldStore.bloom.assign(words, 0);
+    coldStore.bloomAdded = 0;
+    
+    ColdLeaf leaf;
+    for (unsigned int page = coldFirstLeaf(); page != 0; page = leaf.next) {
+        readColdLeaf(page, leaf);
+        for (size_t i = 0; i < leaf.records.size(); i++) {
+            bloomAdd(coldRowId(leaf.records[i].row));
+        }
+    }
+}
+
+// Inserts or replaces the record under page. When the page splits, returns
+// true with the new right sibling and the first ID it holds.
+bool coldInsertInto(unsigned int page, const ColdRecord& record, const string& id,
+                    string& splitKey, unsigned int& splitPage) {
+    char data[COLD_PAGE_SIZE];
+    readColdPage(page, data);
+    
+    if (data[0] == COLD_LEAF) {
+        ColdLeaf leaf;
+        decodeColdLeaf(data, leaf);
+        size_t position = coldRecordPosition(leaf, id);
+        if (coldRecordAt(leaf, position, id)) {
+            leaf.records[position] = record;
+        } else {
+            leaf.records.insert(leaf.records.begin() + position, record);
+            coldStore.rows++;
+        }
+        
+        if (coldLeafBytes(leaf) <= COLD_PAGE_SIZE) {
+            encodeColdLeaf(leaf, data);
+            writeColdPage(page, data);
+            return false;
+        }
+        
+        // Split by bytes, so both halves fit whatever the row lengths.
+        int half = (coldLeafBytes(leaf) - COLD_LEAF_HEADER) / 2;
+        size_t middle = 0;
+        for (int bytes = 0; middle + 1 < leaf.records.size() && bytes < half; middle++) {
+            bytes += COLD_RECORD_HEADER + leaf.records[middle].row.size();
+        }
+        ColdLeaf right;
+        right.records.assign(leaf.records.begin() + middle, leaf.records.end());
+        leaf.records.resize(middle);
+        splitPage = coldStore.pageCount++;
+        right.next = leaf.next;
+        leaf.next = splitPage;
+        
+        encodeColdLeaf(leaf, data);
+        writeColdPage(page, data);
+        encodeColdLeaf(right, data);
+        writeColdPage(splitPage, data);
+        splitKey = coldRowId(right.records[0].row);
+        return true;
+    }
+    
+    ColdInternal node;
+    decodeColdInternal(data, node);
+    size_t child = upper_bound(node.keys.begin(), node.keys.end(), id) - node.keys.begin();
+    string childKey;
+    unsigned int childPage;
+    if (!coldInsertInto(node.children[child], record, id, childKey, childPage)) return false;
+    
+    node.keys.insert(node.keys.begin() + child, childKey);
+    node.children.insert(node.children.begin() + child + 1, childPage);
+    if ((int)node.keys.size() <= COLD_MAX_KEYS) {
+        encodeColdInternal(node, data);
+        writeColdPage(page, data);
+        return false;
+    }
+    
+    size_t middle = node.keys.size() / 2;
+    ColdInternal right;
+    right.keys.assign(node.keys.begin() + middle + 1, node.keys.end());
+    right.children.assign(node.children.begin() + middle + 1, node.children.end());
+    splitKey = node.keys[middle];
+    node.keys.resize(middle);
+    node.children.resize(middle + 1);
+    splitPage = coldStore.pageCount++;
+    
+    encodeColdInternal(node, data);
+    writeColdPage(page, data);
+    encodeColdInternal(right, data);
+    writeColdPage(splitPage, data);
+    return true;
+}
+
+void coldInsert(const ColdRecord& record) {
+    char data[COLD_PAGE_SIZE];
+    if (coldStore.root == 0) {
+        ColdLeaf empty;
+        empty.next = 0;
+        coldStore.root = coldStore.pageCount++;
+        encodeColdLeaf(empty, data);
+        writeColdPage(coldStore.root, data);
+    }
+    
+    string id = coldRowId(record.row);
+    string splitKey;
+    unsigned int splitPage;
+    if (coldInsertInto(coldStore.root, record, id, splitKey, splitPage)) {
+        ColdInternal root;
+        root.keys.push_back(splitKey);
+        root.children.push_back(coldStore.root);
+        root.children.push_back(splitPage);
+        coldStore.root = coldStore.pageCount++;
+        encodeColdInternal(root, data);
+        writeColdPage(coldStore.root, data);
+    }
+    
+    bloomAdd(id);
+    if (coldStore.bloomAdded >= coldStore.bloomCapacity) rebuildBloom();
+}
+
+bool coldFind(const string& id, ColdRecord& out) {
+    if (coldStore.rows == 0) return false;
+    if (!bloomMayContain(id)) {
+        coldStore.bloomSkips++;
+        return false;
+    }
+    
+    ColdLeaf leaf;
+    readColdLeaf(coldLeafFor(id), leaf);
+    size_t position = coldRecordPosition(leaf, id);
+    if (!coldRecordAt(leaf, position, id)) return false;
+    out = leaf.records[position];
+    return true;
+}
+
+bool coldErase(const string& id) {
+    if (coldStore.rows == 0) return false;
+    
+    unsigned int page = coldLeafFor(id);
+    ColdLeaf leaf;
+    readColdLeaf(page, leaf);
+    size_t position = coldRecordPosition(leaf, id);
+    if (!coldRecordAt(leaf, position, id)) return false;
+    
+    leaf.records.erase(leaf.records.begin() + position);
+    char data[COLD_PAGE_SIZE];
+    encodeColdLeaf(leaf, data);
+    writeColdPage(page, data);
+    coldStore.rows--;
+    return true;
+}
+
+bool coldSetStamp(const string& id, unsigned int stamp) {
+    unsigned int page = coldLeafFor(id);
+    ColdLeaf leaf;
+    readColdLeaf(page, leaf);
+    size_t position = coldRecordPosition(leaf, id);
+    if (!coldRecordAt(leaf, position, id)) return false;
+    
+    leaf.records[position].stamp = stamp;
+    char data[COLD_PAGE_SIZE];
+    encodeColdLeaf(leaf, data);
+    writeColdPage(page, data);
+    return true;
+}
+
+// Empties the tier; called by initSystem.
+void resetColdStore() {
+    if (!coldStore.enabled) return;
+    coldStore.frames.clear();
+    coldStore.frameOf.clear();
+    coldStore.clockHand = 0;
+    coldStore.root = 0;
+    coldStore.pageCount = 1;
+    coldStore.pagesOnDisk = 0;
+    coldStore.rows = 0;
+    coldStore.evictAfter = 0;
+    rebuildBloom();
+}
+
+bool openColdStore(const string& path, int hotLimit, int cachePages) {
+    coldStore.file.open(path, ios::in | ios::out | ios::binary | ios::trunc);
+    if (!coldStore.file) {
+        cerr << "Error: Could not open cold store '" << path << "'!\n";
+        return false;
+    }
+    coldStore.enabled = true;
+    coldStore.hotLimit = hotLimit;
+    coldStore.cacheCapacity = cachePages;
+    coldStore.frames.reserve(cachePages);
+    coldStore.evictBucket = 0;
+    resetColdStore();
+    return true;
+}
+
+void closeColdStore(const string& path) {
+    if (!coldStore.enabled) return;
+    coldStore.file.close();
+    coldStore.enabled = false;
+    coldStore.frames.clear();
+    coldStore.frames.shrink_to_fit();
+    coldStore.frameOf.clear();
+    remove(path.c_str());
+}
+
+// Also releases any previous inventory, so loading or re-benchmarking
+// does not leak the old nodes. Feed consumers and the query cache see a
+// 'C' event.
+void initSystem() {
+    for (int i = 0; i < 100; i++) {
+        HashNode* current = hashTable[i];
+        while (current != NULL) {
+            HashNode* next = current->next;
+            retireVersion(current);
+            freeHashNode(current);
+            current = next;
+        }
+        hashTable[i] = NULL;
+    }
+    freeBST(bstRoot);
+    bstRoot = NULL;
+    freeStack(undoStack);
+    freeStack(redoStack);
+    undoStack = NULL;
+    redoStack = NULL;
+    productCount = 0;
+    dirtyStockList = NULL;
+    lowStockHeap.clear();
+    for (int view = 0; view < VIEW_COUNT; view++) {
+        freeView(sortedViews[view]);
+        sortedViews[view] = NULL;
+    }
+    fill(locationUnits.begin(), locationUnits.end(), 0);
+    fill(locationValue.begin(), locationValue.end(), 0);
+    residentProducts = 0;
+    resetColdStore();
+    
+    Product cleared;
+    cleared.id = "";
+    publishChange('C', cleared);
+}
+
+HashNode* findResidentNode(const string& id) {
+    ProductKey key = makeProductKey(id);
+    HashNode* current = hashTable[hashKey(key)];
+    while (current != NULL) {
+        if (sameKey(current->key, current->product.id, key, id)) {
+            current->referenced.store(true, memory_order_relaxed);
+            return current;
+        }
+        current = current->next;
+    }
+    return NULL;
+}
+
+// Pages the product in from the cold store if it was evicted. A returned
+// node stays valid until the next lookup of a different product.
+HashNode* findHashNode(const string& id) {
+    HashNode* node = findResidentNode(id);
+    if (node == NULL && coldStore.enabled) node = faultInProduct(id);
+    return node;
+}
+
+// Queues a product whose pending counters need folding. Lock-free push;
+// the queued flag keeps each product on the list at most once.
+void markStockDirty(HashNode* node) {
+    if (node->counters.queued.exchange(true)) return;
+    
+    HashNode* head = dirtyStockList.load();
+    do {
+        node->dirtyNext = head;
+    } while (!dirtyStockList.compare_exchange_weak(head, node));
+}
+
+// Folds committed stock and sales into the stored products. Only products
+// that changed are visited and the price index is patched in place, since
+// these counters never move a product's price. Returns the products updated.
+int applyStockBatch() {
+    HashNode* node = dirtyStockList.exchange(NULL);
+    int applied = 0;
+    
+    while (node != NULL) {
+        HashNode* next = node->dirtyNext;
+        node->counters.queued = false;
+        
+        int sold = node->counters.pendingSold.exchange(0);
+        int sales = node->counters.pendingSales.exchange(0);
+        int oldMargin = stockMargin(node);
+        Product old = node->product;
+        node->product.stock -= sold;
+        node->product.sales += sales;
+        heapUpdate(node, oldMargin);
+        updateViews(node, old);
+        updateLocations(node, old);
+        recordVersion(node);
+        node->rowHash = 0;
+        recordSalesEvent(node, sales);
+        
+        BSTNode* treeNode = findBSTNode(bstRoot, node->product.price, node->key, node->product.id);
+        if (treeNode != NULL) {
+            treeNode->product.stock = node->product.stock;
+            treeNode->product.sales = node->product.sales;
+        }
+        publishChange('U', node->product);
+        
+        applied++;
+        node = next;
+    }
+    return applied;
+}
+
+// 1-based rank of the product in the view, or -1 if it does not exist.
+int productRank(const string& id, int sortBy, bool ascending) {
+    HashNode* item = findHashNode(id);
+    if (item == NULL || sortBy < 1 || sortBy > VIEW_COUNT) return -1;
+    
+    int view = sortBy - 1;
+    long long value = viewValue(view, item->product);
+    ViewNode* node = sortedViews[view];
+    int before = 0;
+    while (node != NULL) {
+        int cmp = compareViewEntries(value, item->key, item->product.id, node);
+        if (cmp < 0) {
+            node = node->left;
+        } else if (cmp > 0) {
+            before += viewSize(node->left) + 1;
+            node = node->right;
+        } else {
+            before += viewSize(node->left);
+            break;
+        }
+    }
+    return ascending ? before + 1 : viewSize(sortedViews[view]) - before;
+}
+
+// Appends the products at ascending positions [from, to) of the subtree.
+// Evicted products are read from the cold store without paging them in.
+void collectViewRange(ViewNode* node, int from, int to, vector<Product>& out) {
+    if (node == NULL || from >= to) return;
+    
+    int leftSize = viewSize(node->left);
+    if (from < leftSize) collectViewRange(node->left, from, min(to, leftSize), out);
+    if (from <= leftSize && leftSize < to) {
+        if (node->item != NULL) {
+            out.push_back(node->item->product);
+        } else {
+            Product p;
+            if (readColdProduct(node->id, p)) out.push_back(p);
+        }
+    }
+    if (to > leftSize + 1) collectViewRange(node->right, max(from - leftSize - 1, 0), to - leftSize - 1, out);
+}
+
+// Products at 1-based ranks fromRank..toRank (inclusive) of the view.
+void rankRange(int sortBy, bool ascending, int fromRank, int toRank, vector<Product>& out) {
+    out.clear();
+    if (sortBy < 1 || sortBy > VIEW_COUNT) return;
+    
+    ViewNode* root = sortedViews[sortBy - 1];
+    int n = viewSize(root);
+    fromRank = max(fromRank, 1);
+    toRank = min(toRank, n);
+    if (fromRank > toRank) return;
+    
+    if (ascending) {
+        collectViewRange(root, fromRank - 1, toRank, out);
+    } else {
+        collectViewRange(root, n - toRank, n - fromRank + 1, out);
+        reverse(out.begin(), out.end());
+    }
+}
+
+// 1-based page of pageSize products.
+void sortedPage(int sortBy, bool ascending, int page, int pageSize, vector<Product>& out) {
+    long long first = (long long)(page - 1) * pageSize + 1;
+    if (page < 1 || pageSize < 1 || first > INT_MAX) {
+        out.clear();
+        return;
+    }
+    rankRange(sortBy, ascending, first, (int)min(first + pageSize - 1, (long long)INT_MAX), out);
+}
+
+// Puts a product into the hash table, price BST, sorted views and low-stock
+// heap. Warehouse totals, undo and the change feed are up to the caller.
+// A product paged in from the cold store already has its view entries.
+HashNode* linkProduct(const Product& p, bool inViews = false) {
+    ProductKey key = makeProductKey(p.id);
+    int index = hashKey(key);
+    
+    HashNode* newNode = new HashNode;
+    newNode->product = p;
+    newNode->key = key;
+    newNode->counters.available = p.stock;
+    newNode->counters.reserved = 0;
+    newNode->counters.pendingSold = 0;
+    newNode->counters.pendingSales = 0;
+    newNode->counters.queued = false;
+    newNode->dirtyNext = NULL;
+    newNode->series = NULL;
+    newNode->locations = NULL;
+    newNode->rowHash = 0;
+    newNode->mergeStamp = 0;
+    newNode->referenced.store(true, memory_order_relaxed);
+    newNode->versionSlot = -1;
+    newNode->next = hashTable[index];
+    hashTable[index] = newNode;
+    heapInsert(newNode);
+    if (inViews) setViewItem(p, newNode);
+    else addToViews(newNode);
+    residentProducts++;
+    recordVersion(newNode);
+    
+    bstRoot = insertBST(bstRoot, p);
+    return newNode;
+}
+
+bool addProduct(Product p) {
+    TIME_OPERATION(OP_ADD);
+    TraceScope trace(TRACE_ADD);
+    if (trace.active) writeTraceProduct(p);
+    if (!isValidProductID(p.id)) {
+        cout << "Error: Invalid Product ID!\n";
+        return false;
+    }
+    
+    if (!isValidProductName(p.name)) {
+        cout << "Error: Product name cannot be empty!\n";
+        return false;
+    }
+    
+    if (!isValidPrice(p.price)) {
+        cout << "Error: Price must be non-negative!\n";
+        return false;
+    }
+    
+    if (!isValidRating(p.rating)) {
+        cout << "Error: Rating must be between 0.0 and 5.0!\n";
+        return false;
+    }
+    
+    if (!isValidStock(p.stock)) {
+        cout << "Error: Stock must be non-negative!\n";
+        return false;
+    }
+    
+    if (!isValidSales(p.sales)) {
+        cout << "Error: Sales must be non-negative!\n";
+        return false;
+    }
+    
+    if (!isValidReorderThreshold(p.reorderThreshold)) {
+        cout << "Error: Reorder threshold must be non-negative!\n";
+        return false;
+    }
+    
+    if (findHashNode(p.id) != NULL) {
+        cout << "Error: Product ID already exists!\n";
+        return false;
+    }
+    
+    HashNode* newNode = linkProduct(p);
+    addToLocations(newNode);
+    
+    Product empty;
+    empty.id = "";
+    pushStack(undoStack, "ADD", p, empty);
+    publishChange('A', p);
+    evictColdProducts();
+    
+    cout << "Product added successfully!\n";
+    return true;
+}
+
+Product* searchProduct(string id) {
+    TIME_OPERATION(OP_SEARCH);
+    TraceScope trace(TRACE_SEARCH);
+    if (trace.active) writeTraceString(id);
+    if (!isValidProductID(id)) {
+        cout << "Error: Invalid Product ID format!\n";
+        return NULL;
+    }
+    
+    HashNode* node = findHashNode(id);
+    return node != NULL ? &node->product : NULL;
+}
+
+bool updateProduct(string id, Product newProduct) {
+    TIME_OPERATION(OP_UPDATE);
+    TraceScope trace(TRACE_UPDATE);
+    if (trace.active) {
+        writeTraceString(id);
+        writeTraceProduct(newProduct);
+    }
+    if (!isValidProductID(id)) {
+        cout << "Error: Invalid Product ID!\n";
+        return false;
+    }
+    
+    applyStockBatch();
+    
+    HashNode* node = findHashNode(id);
+    if (node == NULL) {
+        cout << "Product not found!\n";
+        return false;
+    }
+    Product* oldProduct = &node->product;
+    
+    if (!isValidProductName(newProduct.name)) {
+        cout << "Error: Product name cannot be empty!\n";
+        return false;
+    }
+    
+    if (!isValidPrice(newProduct.price)) {
+        cout << "Error: Price must be non-negative!\n";
+        return false;
+    }
+    
+    if (!isValidRating(newProduct.rating)) {
+        cout << "Error: Rating must be between 0.0 and 5.0!\n";
+        return false;
+    }
+    
+    if (!isValidStock(newProduct.stock)) {
+        cout << "Error: Stock must be non-negative!\n";
+        return false;
+    }
+    
+    if (!isValidSales(newProduct.sales)) {
+        cout << "Error: Sales must be non-negative!\n";
+        return false;
+    }
+    
+    if (!isValidReorderThreshold(newProduct.reorderThreshold)) {
+        cout << "Error: Reorder threshold must be non-negative!\n";
+        return false;
+    }
+    
+    if (newProduct.stock < node->counters.reserved) {
+        cout << "Error: Stock cannot drop below the " << node->counters.reserved << " units reserved!\n";
+        return false;
+    }
+    
+    Product oldCopy = *oldProduct;
+    pushStack(undoStack, "UPDATE", newProduct, oldCopy);
+    
+    int oldMargin = stockMargin(node);
+    *oldProduct = newProduct;
+    node->counters.available += newProduct.stock - oldCopy.stock;
+    heapUpdate(node, oldMargin);
+    updateViews(node, oldCopy);
+    updateLocations(node, oldCopy);
+    recordVersion(node);
+    node->rowHash = 0;
+    if (newProduct.stock != oldCopy.stock || newProduct.sales != oldCopy.sales) {
+        recordSalesEvent(node, newProduct.sales - oldCopy.sales);
+    }
+    
+    if (newProduct.price == oldCopy.price) {
+        BSTNode* treeNode = findBSTNode(bstRoot, oldCopy.price, node->key, id);
+        if (treeNode != NULL) treeNode->product = newProduct;
+    } else {
+        {
+            TIME_OPERATION(OP_DELETE_BST);
+            bstRoot = deleteBSTAt(bstRoot, oldCopy.price, node->key, id);
+        }
+        bstRoot = insertBST(bstRoot, newProduct);
+    }
+    publishChange('U', newProduct);
+    
+    cout << "Product updated successfully!\n";
+    return true;
+}
+
+bool deleteProduct(string id) {
+    TIME_OPERATION(OP_DELETE);
+    TraceScope trace(TRACE_DELETE);
+    if (trace.active) writeTraceString(id);
+    if (!isValidProductID(id)) {
+        cout << "Error: Invalid Product ID!\n";
+        return false;
+    }
+    
+    // A product on the dirty list must not be freed under it.
+    applyStockBatch();
+    findHashNode(id);  // pages it in if it was evicted
+    
+    ProductKey key = makeProductKey(id);
+    int index = hashKey(key);
+    HashNode* current = hashTable[index];
+    HashNode* prev = NULL;
+    
+    while (current != NULL) {
+        if (sameKey(current->key, current->product.id, key, id)) {
+            pushStack(undoStack, "DELETE", current->product, current->product);
+            publishChange('D', current->product);
+            
+            if (prev == NULL) {
+                hashTable[index] = current->next;
+            } else {
+                prev->next = current->next;
+            }
+            heapRemove(current);
+            removeFromViews(current);
+            removeFromLocations(current);
+            retireVersion(current);
+            
+            {
+                TIME_OPERATION(OP_DELETE_BST);
+                bstRoot = deleteBSTAt(bstRoot, current->product.price, key, id);
+            }
+            freeHashNode(current);
+            residentProducts--;
+            
+            cout << "Product deleted successfully!\n";
+            return true;
+        }
+        prev = current;
+        current = current->next;
+    }
+    cout << "Product not found!\n";
+    return false;
+}
+
+// ========== STOCK RESERVATIONS ==========
+// Lightweight order-processing operations that only touch the atomic
+// counters of one product: no undo copies and no price index rebuild.
+//
+// The node functions (reserveUnits and friends) are lock-free, print
+// nothing and may be called from several threads at once, on nodes taken
+// from the hash table while no product is added, deleted or paged in or
+// out. The owning thread may run applyStockBatch meanwhile. The functions
+// taking an ID look the product up, report errors on cout and record the
+// trace, so they belong to the owning thread like the rest of the catalog.
+
+// Records one of the order-processing operations below.
+void traceStockRequest(int op, const string& id, int quantity) {
+    TraceScope trace(op);
+    if (trace.active) {
+        writeTraceString(id);
+        writeTraceInt(quantity);
+    }
+}
+
+bool checkStockRequest(HashNode* node, const string& id, int quantity) {
+    if (node == NULL) {
+        cout << "Error: Product '" << id << "' not found!\n";
+        return false;
+    }
+    if (quantity <= 0) {
+        cout << "Error: Quantity must be positive!\n";
+        return false;
+    }
+    return true;
+}
+
+// Moves quantity from one counter to another if at least that much is there.
+bool transferCounter(atomic<int>& from, atomic<int>& to, int quantity) {
+    int current = from.load();
+    do {
+        if (current < quantity) return false;
+    } while (!from.compare_exchange_weak(current, current - quantity));
+    to += quantity;
+    return true;
+}
+
+bool reserveUnits(HashNode* node, int quantity) {
+    return transferCounter(node->counters.available, node->counters.reserved, quantity);
+}
+
+bool releaseUnits(HashNode* node, int quantity) {
+    return transferCounter(node->counters.reserved, node->counters.available, quantity);
+}
+
+// Turns reserved units into a sale: stock goes down and sales go up once
+// the next batch is applied.
+bool commitUnits(HashNode* node, int quantity) {
+    if (!transferCounter(node->counters.reserved, node->counters.pendingSold, quantity)) return false;
+    node->counters.pendingSales += quantity;
+    markStockDirty(node);
+    return true;
+}
+
+void sellUnits(HashNode* node, int quantity) {
+    node->counters.pendingSales += quantity;
+    markStockDirty(node);
+}
+
+bool reserveStock(string id, int quantity) {
+    if (traceRecording) traceStockRequest(TRACE_RESERVE, id, quantity);
+    HashNode* node = findHashNode(id);
+    if (!checkStockRequest(node, id, quantity)) return false;
+    
+    if (!reserveUnits(node, quantity)) {
+        cout << "Error: Only " << node->counters.available << " units of '" << id << "' available!\n";
+        return false;
+    }
+    return true;
+}
+
+bool releaseStock(string id, int quantity) {
+    if (traceRecording) traceStockRequest(TRACE_RELEASE, id, quantity);
+    HashNode* node = findHashNode(id);
+    if (!checkStockRequest(node, id, quantity)) return false;
+    
+    if (!releaseUnits(node, quantity)) {
+        cout << "Error: Only " << node->counters.reserved << " units of '" << id << "' reserved!\n";
+        return false;
+    }
+    return true;
+}
+
+bool commitStock(string id, int quantity) {
+    if (traceRecording) traceStockRequest(TRACE_COMMIT, id, quantity);
+    HashNode* node = findHashNode(id);
+    if (!checkStockRequest(node, id, quantity)) return false;
+    
+    if (!commitUnits(node, quantity)) {
+        cout << "Error: Only " << node->counters.reserved << " units of '" << id << "' reserved!\n";
+        return false;
+    }
+    return true;
+}
+
+bool incrementSales(string id, int quantity) {
+    if (traceRecording) traceStockRequest(TRACE_SELL, id, quantity);
+    HashNode* node = findHashNode(id);
+    if (!checkStockRequest(node, id, quantity)) return false;
+    
+    sellUnits(node, quantity);
+    return true;
+}
+
+// ========== WAREHOUSE STOCK ==========
+
+// Sets the stock held at one location; the product's total changes by the
+// same amount and goes through updateProduct (undo, feed, alerts).
+bool setLocationStock(string id, string locationName, int quantity) {
+    TraceScope trace(TRACE_PLACE);
+    if (trace.active) {
+        writeTraceString(id);
+        writeTraceString(locationName);
+        writeTraceInt(quantity);
+    }
+    applyStockBatch();
+    HashNode* node = findHashNode(id);
+    if (node == NULL) {
+        cout << "Error: Product with ID '" << id << "' not found!\n";
+        return false;
+    }
+    if (!isValidStock(quantity)) {
+        cout << "Error: Stock must be non-negative!\n";
+        return false;
+    }
+    int location = registerLocation(locationName);
+    if (location < 0) {
+        cout << "Error: Invalid location name '" << locationName << "'!\n";
+        return false;
+    }
+    
+    int delta = quantity - locationQuantity(node, location);
+    if (delta == 0) return true;
+    if ((long long)node->product.stock + delta > INT_MAX) {
+        cout << "Error: Total stock would be out of range!\n";
+        return false;
+    }
+    
+    Product updated = node->product;
+    updated.stock += delta;
+    materializeLocations(node);
+    adjustLocation(node, location, delta, node->product.price);
+    if (!updateProduct(id, updated)) {
+        adjustLocation(node, location, -delta, node->product.price);
+        collapseLocations(node);
+        return false;
+    }
+    return true;
+}
+
+// Moves units between locations; the product's total does not change.
+bool moveStock(string id, string fromName, string toName, int quantity) {
+    TraceScope trace(TRACE_MOVE);
+    if (trace.active) {
+        writeTraceString(id);
+        writeTraceString(fromName);
+        writeTraceString(toName);
+        writeTraceInt(quantity);
+    }
+    applyStockBatch();
+    HashNode* node = findHashNode(id);
+    if (node == NULL) {
+        cout << "Error: Product with ID '" << id << "' not found!\n";
+        return false;
+    }
+    if (quantity <= 0) {
+        cout << "Error: Quantity must be positive!\n";
+        return false;
+    }
+    int from = findLocation(fromName);
+    int to = registerLocation(toName);
+    if (from < 0 || to < 0) {
+        cout << "Error: Invalid location name '" << (from < 0 ? fromName : toName) << "'!\n";
+        return false;
+    }
+    if (locationQuantity(node, from) < quantity) {
+        cout << "Error: Only " << locationQuantity(node, from) << " units of '" << id
+             << "' at " << fromName << "!\n";
+        return false;
+    }
+    
+    materializeLocations(node);
+    adjustLocation(node, from, -quantity, node->product.price);
+    adjustLocation(node, to, quantity, node->product.price);
+    collapseLocations(node);
+    recordVersion(node);
+    return true;
+}
+
+// Locations holding the product, in registration order.
+bool productLocations(string id, vector<LocationStock>& out) {
+    applyStockBatch();
+    out.clear();
+    HashNode* node = findHashNode(id);
+    if (node == NULL) return false;
+    
+    if (node->locations == NULL) {
+        if (node->product.stock > 0) out.push_back({0, node->product.stock});
+    } else {
+        out = *node->locations;
+    }
+    return true;
+}
+
+void displayWarehouseTotals() {
+    applyStockBatch();
+    cout << "\n=== WAREHOUSE TOTALS ===\n";
+    cout << left << setw(20) << "Location";
+    cout << left << setw(12) << "Units";
+    cout << left << setw(15) << "Stock Value" << endl;
+    cout << string(47, '-') << endl;
+    for (size_t i = 0; i < locationNames.size(); i++) {
+        cout << left << setw(20) << locationNames[i];
+        cout << left << setw(12) << locationUnits[i];
+        cout << "$" << formatMoney(locationValue[i]) << endl;
+    }
+    cout << string(47, '-') << endl;
+}
+
+// ========== QUERY CACHE ==========
+// Results of sortProducts and price range queries, kept for reporting
+// users who run the same queries over and over. Entries are keyed by the
+// normalized query and stamped with the change feed sequence they are
+// valid at; every change to a product is published to the feed, so an
+// entry is current while the feed has not moved. A stale entry is patched
+// by replaying the few events since its stamp (drop the old row, insert
+// the new one at its sorted position) and recomputed when there are more
+// than QUERY_PATCH_LIMIT of them, the catalog was cleared, or the events
+// are no longer buffered. Entries are evicted least recently used first
+// once their estimated size exceeds the budget (INVENTORY_QUERY_CACHE_KB,
+// 0 turns the cache off). Patched results may order equal keys
+// differently from a fresh sort.
+
+const int QUERY_PATCH_LIMIT = 64;
+
+struct QueryCacheEntry {
+    string key;
+    char kind;                 // 'S' sort, 'R' price range
+    SortSpec spec;
+    Money minPrice, maxPrice;
+    bool complete;             // sort: holds every product, so it can be patched
+    long long sequence;        // change feed position the rows are valid at
+    vector<Product> rows;
+    size_t bytes;
+    QueryCacheEntry* prev;     // LRU list, most recently used first
+    QueryCacheEntry* next;
+};
+
+map<string, QueryCacheEntry*> queryCache;
+QueryCacheEntry* queryCacheHead = NULL;
+QueryCacheEntry* queryCacheTail = NULL;
+size_t queryCacheBytes = 0;
+size_t queryCacheBudget = 4096 * 1024;
+long long queryCacheHits = 0, queryCachePatched = 0, queryCacheMisses = 0, queryCacheEvictions = 0;
+vector<Product> queryScratch;  // results when the cache is off or they do not fit
+
+size_t queryEntryBytes(const QueryCacheEntry* entry) {
+    size_t bytes = sizeof(QueryCacheEntry) + entry->key.capacity() + entry->rows.capacity() * sizeof(Product);
+    for (size_t i = 0; i < entry->rows.size(); i++) {
+        if (entry->rows[i].id.capacity() > 15) bytes += entry->rows[i].id.capacity() + 1;
+    }
+    return bytes;
+}
+
+void unlinkQueryEntry(QueryCacheEntry* entry) {
+    if (entry->prev != NULL) entry->prev->next = entry->next;
+    else queryCacheHead = entry->next;
+    if (entry->next != NULL) entry->next->prev = entry->prev;
+    else queryCacheTail = entry->prev;
+}
+
+void pushQueryEntry(QueryCacheEntry* entry) {
+    entry->prev = NULL;
+    entry->next = queryCacheHead;
+    if (queryCacheHead != NULL) queryCacheHead->prev = entry;
+    queryCacheHead = entry;
+    if (queryCacheTail == NULL) queryCacheTail = entry;
+}
+
+void dropQueryEntry(QueryCacheEntry* entry) {
+    unlinkQueryEntry(entry);
+    queryCache.erase(entry->key);
+    queryCacheBytes -= entry->bytes;
+    delete entry;
+}
+
+// Evicts least recently used entries, never the one just used.
+void trimQueryCache(QueryCacheEntry* keep) {
+    while (queryCacheBytes > queryCacheBudget && queryCacheTail != NULL && queryCacheTail != keep) {
+        dropQueryEntry(queryCacheTail);
+        queryCacheEvictions++;
+    }
+}
+
+void setQueryCacheBudget(size_t bytes) {
+    queryCacheBudget = bytes;
+    trimQueryCache(NULL);
+}
+
+void computeQueryRows(QueryCacheEntry* entry, int algorithm) {
+    entry->rows.clear();
+    if (entry->kind == 'R') {
+        collectRangeBST(bstRoot, entry->minPrice, entry->maxPrice, entry->rows);
+        size_t resident = entry->rows.size();
+        collectColdProducts(entry->rows, entry->minPrice, entry->maxPrice);
+        if (entry->rows.size() > resident) {
+            stable_sort(entry->rows.begin(), entry->rows.end(),
+                        [](const Product& a, const Product& b) { return a.price < b.price; });
+        }
+        return;
+    }
+    
+    copyProductsToArray();
+    vector<Product> coldProducts;
+    collectColdProducts(coldProducts);
+    for (size_t i = 0; i < coldProducts.size() && productCount < 1000; i++) {
+        productArray[productCount++] = coldProducts[i];
+    }
+    entry->complete = residentProducts + (coldStore.enabled ? coldStore.rows : 0) <= 1000;
+    sortProductArray(productArray, productCount, entry->spec, algorithm);
+    entry->rows.assign(productArray, productArray + productCount);
+}
+
+// Applies the change events to the rows; false if it must be recomputed.
+bool patchQueryRows(QueryCacheEntry* entry, const vector<ChangeEvent>& events) {
+    if (entry->kind == 'S' && !entry->complete) return false;
+    
+    vector<Product>& rows = entry->rows;
+    for (size_t i = 0; i < events.size(); i++) {
+        const ChangeEvent& event = events[i];
+        if (event.type == 'C') return false;
+        
+        for (size_t j = 0; j < rows.size(); j++) {
+            if (rows[j].id == event.product.id) {
+                rows.erase(rows.begin() + j);
+                break;
+            }
+        }
+        if (event.type == 'D') continue;
+        
+        const Product& p = event.product;
+        vector<Product>::iterator position;
+        if (entry->kind == 'R') {
+            if (p.price < entry->minPrice || p.price > entry->maxPrice) continue;
+            position = upper_bound(rows.begin(), rows.end(), p,
+                                   [](const Product& a, const Product& b) { return a.price < b.price; });
+        } else {
+            const SortSpec& spec = entry->spec;
+            position = upper_bound(rows.begin(), rows.end(), p, [&spec](const Product& a, const Product& b) {
+                return compareProductsBy(a, b, spec) < 0;
+            });
+        }
+        rows.insert(position, p);
+    }
+    return entry->kind == 'R' || rows.size() <= 1000;
+}
+
+// Cached rows for the query; valid until the next query or change.
+const vector<Product>& cachedQuery(const string& key, char kind, const SortSpec& spec, int algorithm,
+                                   Money minPrice, Money maxPrice) {
+    long long sequence = feedPublished.load(memory_order_acquire);
+    QueryCacheEntry* entry = NULL;
+    map<string, QueryCacheEntry*>::iterator it = queryCache.find(key);
+    if (it != queryCache.end()) {
+        entry = it->second;
+        unlinkQueryEntry(entry);
+        queryCacheBytes -= entry->bytes;
+    } else {
+        entry = new QueryCacheEntry;
+        entry->key = key;
+        entry->kind = kind;
+        entry->spec = spec;
+        entry->minPrice = minPrice;
+        entry->maxPrice = maxPrice;
+        entry->complete = false;
+        entry->sequence = -1;
+    }
+    
+    vector<ChangeEvent> events;
+    if (entry->sequence == sequence) {
+        queryCacheHits++;
+    } else if (entry->sequence >= 0 && sequence - entry->sequence <= QUERY_PATCH_LIMIT &&
+               readChangesSince(entry->sequence, events, QUERY_PATCH_LIMIT) && patchQueryRows(entry, events)) {
+        queryCachePatched++;
+    } else {
+        queryCacheMisses++;
+        computeQueryRows(entry, algorithm);
+    }
+    entry->sequence = sequence;
+    entry->bytes = queryEntryBytes(entry);
+    
+    if (entry->bytes > queryCacheBudget) {
+        queryCache.erase(key);
+        queryScratch.swap(entry->rows);
+        delete entry;
+        return queryScratch;
+    }
+    queryCache[key] = entry;
+    pushQueryEntry(entry);
+    queryCacheBytes += entry->bytes;
+    trimQueryCache(entry);
+    return entry->rows;
+}
+
+// Products sorted as sortProducts shows them (at most 1000).
+const vector<Product>& cachedSort(const SortSpec& spec, int algorithm) {
+    if (algorithm != 1) algorithm = 2;
+    string key = "S" + to_string(algorithm) + ":" + formatSortSpec(spec);
+    return cachedQuery(key, 'S', spec, algorithm, 0, 0);
+}
+
+// Products priced within [minPrice, maxPrice], cheapest first.
+const vector<Product>& cachedRange(Money minPrice, Money maxPrice) {
+    SortSpec byPrice = singleKeySpec(1, true);
+    string key = "R" + to_string(minPrice) + "," + to_string(maxPrice);
+    return cachedQuery(key, 'R', byPrice, 0, minPrice, maxPrice);
+}
+
+void displayProductRow(const Product& p) {
+    cout << left << setw(8) << p.id;
+    cout << left << setw(25) << p.name;
+    cout << left << setw(20) << p.category;
+    cout << "$" << left << setw(11) << formatMoney(p.price);
+    cout << left << setw(8) << fixed << setprecision(1) << p.rating;
+    cout << left << setw(10) << p.stock;
+    cout << left << setw(8) << p.sales << endl;
+}
+
+void displayAllProducts() {
+    applyStockBatch();
+    cout << "\n=== ALL PRODUCTS ===\n";
+    cout << left << setw(8) << "ID";
+    cout << left << setw(25) << "Name";
+    cout << left << setw(20) << "Category";
+    cout << left << setw(12) << "Price";
+    cout << left << setw(8) << "Rating";
+    cout << left << setw(10) << "Stock";
+    cout << left << setw(8) << "Sales" << endl;
+    cout << string(90, '-') << endl;
+    
+    int count = 0;
+    for (int i = 0; i < 100; i++) {
+        HashNode* current = hashTable[i];
+        while (current != NULL) {
+            displayProductRow(current->product);
+            count++;
+            current = current->next;
+        }
+    }
+    
+    // Products evicted to the cold store follow, in ID order.
+    vector<Product> coldProducts;
+    collectColdProducts(coldProducts);
+    for (size_t i = 0; i < coldProducts.size(); i++) {
+        displayProductRow(coldProducts[i]);
+        count++;
+    }
+    cout << string(90, '-') << endl;
+    cout << "Total Products: " << count << "\n";
+}
+
+void displaySortedPage(int sortBy, bool ascending, int page, int pageSize) {
+    applyStockBatch();
+    vector<Product> rows;
+    sortedPage(sortBy, ascending, page, pageSize, rows);
+    
+    int total = viewSize(sortedViews[sortBy - 1]);
+    int pages = (total + pageSize - 1) / pageSize;
+    cout << "\n=== PAGE " << page << " OF " << pages << " ===\n";
+    cout << left << setw(8) << "Rank";
+    cout << left << setw(8) << "ID";
+    cout << left << setw(25) << "Name";
+    cout << left << setw(12) << "Price";
+    cout << left << setw(8) << "Rating";
+    cout << left << setw(8) << "Sales" << endl;
+    cout << string(69, '-') << endl;
+    for (size_t i = 0; i < rows.size(); i++) {
+        cout << left << setw(8) << (page - 1) * pageSize + (int)i + 1;
+        cout << left << setw(8) << rows[i].id;
+        cout << left << setw(25) << rows[i].name;
+        cout << "$" << left << setw(11) << formatMoney(rows[i].price);
+        cout << left << setw(8) << fixed << setprecision(1) << rows[i].rating;
+        cout << left << setw(8) << rows[i].sales << endl;
+    }
+    if (rows.empty()) cout << "No products on this page.\n";
+    cout << string(69, '-') << endl;
+}
+
+void sortProducts(const SortSpec& spec, int algorithm) {
+    TraceScope trace(TRACE_SORT_SPEC);
+    if (trace.active) {
+        writeTraceString(formatSortSpec(spec));
+        writeTraceInt(algorithm);
+    }
+    applyStockBatch();
+    const vector<Product>& rows = cachedSort(spec, algorithm);
+    
+    if (rows.empty()) {
+        cout << "No products to sort!\n";
+        return;
+    }
+    
+    if (algorithm == 1) {
+        cout << "\nSorted by " << formatSortSpec(spec) << " using Merge Sort:\n";
+    } else {
+        cout << "\nSorted by " << formatSortSpec(spec) << " using Quick Sort:\n";
+    }
+    
+    displayProducts(rows.data(), rows.size());
+}
+
+void rangeSearch(Money minPrice, Money maxPrice) {
+    TraceScope trace(TRACE_RANGE);
+    if (trace.active) {
+        writeTraceInt(minPrice);
+        writeTraceInt(maxPrice);
+    }
+    if (minPrice < 0 || maxPrice < 0) {
+        cout << "Error: Prices cannot be negative!\n";
+        return;
+    }
+    
+    if (minPrice > maxPrice) {
+        cout << "Error: Minimum price cannot be greater than maximum price!\n";
+        return;
+    }
+    
+    cout << "\n=== PRODUCTS IN PRICE RANGE $" << formatMoney(minPrice) << " to $" << formatMoney(maxPrice) << " ===\n";
+    TIME_OPERATION(OP_RANGE);
+    applyStockBatch();
+    const vector<Product>& rows = cachedRange(minPrice, maxPrice);
+    for (size_t i = 0; i < rows.size(); i++) {
+        cout << "ID: " << rows[i].id << "\tName: " << rows[i].name
+             << "\tPrice: $" << formatMoney(rows[i].price) << endl;
+    }
+}
+
+void displayLowStockReport() {
+    applyStockBatch();
+    
+    vector<Product> lowStock;
+    lowStockProducts(lowStock);
+    
+    cout << "\n=== LOW STOCK REPORT ===\n";
+    if (lowStock.empty()) {
+        cout << "All products are at or above their reorder threshold.\n";
+        return;
+    }
+    
+    cout << left << setw(8) << "ID";
+    cout << left << setw(25) << "Name";
+    cout << left << setw(10) << "Stock";
+    cout << left << setw(10) << "Threshold" << endl;
+    cout << string(53, '-') << endl;
+    for (size_t i = 0; i < lowStock.size(); i++) {
+        cout << left << setw(8) << lowStock[i].id;
+        cout << left << setw(25) << lowStock[i].name;
+        cout << left << setw(10) << lowStock[i].stock;
+        cout << left << setw(10) << lowStock[i].reorderThreshold << endl;
+    }
+    cout << string(53, '-') << endl;
+    cout << "Products to reorder: " << lowStock.size() << "\n";
+}
+
+int bstDepth(BSTNode* root) {
+    if (root == NULL) return 0;
+    return 1 + max(bstDepth(root->left), bstDepth(root->right));
+}
+
+int bstSize(BSTNode* root) {
+    if (root == NULL) return 0;
+    return 1 + bstSize(root->left) + bstSize(root->right);
+}
+
+// Operation latencies plus structure gauges. The gauges are computed on
+// demand, so they cost nothing until a report is asked for.
+void writeStats(ostream& out) {
+#if INVENTORY_STATS
+    out << left << setw(13) << "Operation" << right << setw(10) << "Count"
+        << setw(12) << "Mean(us)" << setw(11) << "p50(us)" << setw(11) << "p90(us)"
+        << setw(11) << "p99(us)" << setw(12) << "Max(us)" << "\n";
+    out << string(80, '-') << "\n";
+    out << fixed << setprecision(2);
+    for (int op = 0; op < OP_COUNT; op++) {
+        const LatencyHistogram& h = operationStats[op];
+        if (h.count == 0) continue;
+        out << left << setw(13) << operationNames[op] << right << setw(10) << h.count
+            << setw(12) << h.totalNs / 1000.0 / h.count
+            << setw(11) << histogramPercentile(h, 50) / 1000.0
+            << setw(11) << histogramPercentile(h, 90) / 1000.0
+            << setw(11) << histogramPercentile(h, 99) / 1000.0
+            << setw(12) << h.maxNs / 1000.0 << "\n";
+    }
+    out << string(80, '-') << "\n";
+    out << "Allocations: " << allocationCount.load() << " new, " << freeCount.load()
+        << " delete, " << allocatedBytes.load() << " bytes requested\n";
+#else
+    out << "Operation statistics were disabled at compile time (INVENTORY_STATS=0).\n";
+#endif
+    
+    int products = 0, emptyBuckets = 0, longestChain = 0;
+    for (int i = 0; i < 100; i++) {
+        int chain = 0;
+        for (HashNode* current = hashTable[i]; current != NULL; current = current->next) {
+            chain++;
+        }
+        products += chain;
+        if (chain == 0) emptyBuckets++;
+        longestChain = max(longestChain, chain);
+    }
+    out << "Hash table: " << products << " products in 100 buckets, " << emptyBuckets
+        << " empty, longest chain " << longestChain << ", average chain "
+        << fixed << setprecision(2) << (emptyBuckets < 100 ? products / (double)(100 - emptyBuckets) : 0.0) << "\n";
+    out << "Price BST: " << bstSize(bstRoot) << " nodes, depth " << bstDepth(bstRoot) << "\n";
+    if (coldStore.enabled) {
+        out << "Cold store: " << coldStore.rows << " products on disk in " << coldStore.pageCount - 1
+            << " pages, " << residentProducts << " in memory (limit " << coldStore.hotLimit << "), "
+            << coldStore.faults << " paged in, " << coldStore.evictions << " evicted\n";
+        out << "Page cache: " << coldStore.frames.size() << "/" << coldStore.cacheCapacity << " pages, "
+            << coldStore.cacheHits << " hits, " << coldStore.cacheMisses << " misses, "
+            << coldStore.pageReads << " reads, " << coldStore.pageWrites << " writes; Bloom filter skipped "
+            << coldStore.bloomSkips << " lookups\n";
+    }
+    out << "Change feed: " << feedPublished.load() << " events published, " << feedConsumerCount()
+        << " consumers, " << feedWaits << " publishes waited for a consumer\n";
+    out << "String pool: " << poolStrings << " names and categories, "
+        << (poolEnd - 1) / 1024 << " KiB used of " << poolMemoryBytes() / 1024 << " KiB\n";
+    
+    long long oldestVersion, oldestEpoch;
+    int openSnapshots = 0;
+    for (int i = 0; i < MAX_SNAPSHOTS; i++) {
+        if (snapshotReaders[i].active.load(memory_order_acquire)) openSnapshots++;
+    }
+    out << "Snapshots: " << openSnapshots << " open" << (oldestSnapshot(oldestVersion, oldestEpoch) ?
+           " (oldest at version " + to_string(oldestVersion) + ")" : string()) << ", catalog version "
+        << catalogVersion << ", " << liveVersions << " product versions, "
+        << pendingVersionSlots.size() << " products with old versions, "
+        << retiredVersions.size() << " unlinked chains awaiting reclaim\n";
+    out << "Query cache: " << queryCache.size() << " results, " << queryCacheBytes / 1024 << " KiB of "
+        << queryCacheBudget / 1024 << " KiB, " << queryCacheHits << " hits, " << queryCachePatched
+        << " patched, " << queryCacheMisses << " misses, " << queryCacheEvictions << " evicted\n";
+}
+
+void displayStats() {
+    cout << "\n=== OPERATION STATISTICS ===\n";
+    writeStats(cout);
+}
+
+void displaySalesTrends(int days) {
+    applyStockBatch();
+    
+    vector<MoverEntry> movers;
+    long long window = days * SECONDS_PER_DAY;
+    topMovers(10, window, movers);
+    
+    cout << "\n=== TOP MOVERS, LAST " << days << " DAY(S) ===\n";
+    if (movers.empty()) {
+        cout << "No sales recorded in this period.\n";
+        return;
+    }
+    
+    cout << left << setw(8) << "ID";
+    cout << left << setw(25) << "Name";
+    cout << left << setw(10) << "Sold";
+    cout << left << setw(12) << "Per Day";
+    cout << left << setw(10) << "Previous" << endl;
+    cout << string(65, '-') << endl;
+    for (size_t i = 0; i < movers.size(); i++) {
+        cout << left << setw(8) << movers[i].id;
+        cout << left << setw(25) << movers[i].name;
+        cout << left << setw(10) << movers[i].sold;
+        cout << left << setw(12) << fixed << setprecision(2) << movers[i].sold / (double)days;
+        cout << left << setw(10) << movers[i].previous << endl;
+    }
+    cout << string(65, '-') << endl;
+}
+
+void printLowStockAlert(const Product& p) {
+    cout << "ALERT: '" << p.id << "' stock " << p.stock
+         << " is below its reorder threshold of " << p.reorderThreshold << "!\n";
+}
+
+void undoOperation() {
+    TraceScope trace(TRACE_UNDO);
+    string op;
+    Product p, old;
+    
+    if (!popStack(undoStack, op, p, old)) {
+        cout << "Nothing to undo!\n";
+        return;
+    }
+    
+    pushStack(redoStack, op, p, old);
+    
+    if (op == "ADD") {
+        deleteProduct(p.id);
+    } else if (op == "DELETE") {
+        addProduct(p);
+    } else if (op == "UPDATE") {
+        updateProduct(p.id, old);
+    }
+    
+    cout << "Undo operation completed!\n";
+}
+
+void redoOperation() {
+    TraceScope trace(TRACE_REDO);
+    string op;
+    Product p, old;
+    
+    if (!popStack(redoStack, op, p, old)) {
+        cout << "Nothing to redo!\n";
+        return;
+    }
+    
+    if (op == "ADD") {
+        addProduct(p);
+    } else if (op == "DELETE") {
+        deleteProduct(p.id);
+    } else if (op == "UPDATE") {
+        updateProduct(p.id, p);
+    }
+    
+    cout << "Redo operation completed!\n";
+}
+
+void writeProductCSV(ostream& out, const Product& p) {
+    out << p.id << "," << p.name << "," << p.category << ","
+        << formatMoney(p.price) << "," << p.rating << "," 
+        << p.stock << "," << p.sales << "," << p.reorderThreshold;
+}
+
+bool parseLocationsField(const string& field, int stock, vector<LocationStock>& out, string& error) {
+    long long placed = 0;
+    stringstream entries(field);
+    string entry;
+    while (getline(entries, entry, ';')) {
+        size_t colon = entry.find(':');
+        string name = entry.substr(0, colon);
+        string quantityText = colon == string::npos ? "" : entry.substr(colon + 1);
+        int location = registerLocation(name);
+        if (location < 0 || !isValidIntInput(quantityText) || quantityText[0] == '-' ||
+            quantityText.length() > 9) {
+            error = "contains invalid location stock";
+            return false;
+        }
+        out.push_back({location, stoi(quantityText)});
+        placed += out.back().quantity;
+    }
+    if (placed != stock) {
+        error = "has location stock that does not add up to its total";
+        return false;
+    }
+    return true;
+}
+
+// Parses one "id,name,category,price,rating,stock,sales[,reorderThreshold
+// [,locations]]" row; files written before thresholds existed load with a
+// threshold of 0. The optional locations field ("MAIN:5;WH2:10") is only
+// read when the caller asks for it, and must add up to the stock.
+// On failure, error describes the problem for the caller's warning message.
+bool parseProductCSV(const string& line, Product& p, string& error,
+                     vector<LocationStock>* locations = NULL) {
+    vector<string> fields;
+    string field = "";
+    
+    for (size_t i = 0; i < line.length(); i++) {
+        if (line[i] == ',') {
+            fields.push_back(field);
+            field = "";
+        } else {
+            field += line[i];
+        }
+    }
+    fields.push_back(field);
+    
+    if (fields.size() < 7) {
+        error = "has insufficient fields";
+        return false;
+    }
+    
+    try {
+        p.id = fields[0];
+        p.name = fields[1];
+        p.category = fields[2];
+        if (!parseMoney(fields[3], p.price)) {
+            error = "contains invalid number format";
+            return false;
+        }
+        p.rating = stod(fields[4]);
+        p.stock = stoi(fields[5]);
+        p.sales = stoi(fields[6]);
+        p.reorderThreshold = fields.size() > 7 ? stoi(fields[7]) : 0;
+    } catch (const invalid_argument& e) {
+        error = "contains invalid number format";
+        return false;
+    } catch (const out_of_range& e) {
+        error = "contains number out of range";
+        return false;
+    }
+    
+    if (!(isValidProductID(p.id) && isValidProductName(p.name) && 
+          isValidPrice(p.price) && isValidRating(p.rating) &&
+          isValidStock(p.stock) && isValidSales(p.sales) &&
+          isValidReorderThreshold(p.reorderThreshold))) {
+        error = "contains invalid data";
+        return false;
+    }
+    
+    if (locations != NULL) {
+        locations->clear();
+        if (fields.size() > 8 && !fields[8].empty() && !parseLocationsField(fields[8], p.stock, *locations, error)) return false;
+    }
+    return true;
+}
+
+// 64-bit FNV-1a over a file row, to skip unchanged rows on merge.
+unsigned long long hashRow(const string& line) {
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < line.length(); i++) {
+        hash = (hash ^ (unsigned char)line[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Rows of evicted products. Owning thread only: the page cache is not
+// shared, so background saves write these before handing off.
+int writeColdRows(ostream& file) {
+    if (!coldStore.enabled) return 0;
+    
+    int count = 0;
+    ColdLeaf leaf;
+    for (unsigned int page = coldFirstLeaf(); page != 0; page = leaf.next) {
+        readColdLeaf(page, leaf);
+        for (size_t i = 0; i < leaf.records.size(); i++) {
+            file << leaf.records[i].row << "\n";
+            count++;
+        }
+    }
+    return count;
+}
+
+// Resident products as of the snapshot; safe on any thread. Rows are
+// grouped by hash bucket, as a walk of the table would write them, so a
+// reload of the file finds each bucket's chain warm in the cache.
+int writeSnapshotRows(ostream& file, const Snapshot& snapshot) {
+    vector<const ProductVersion*> visible;
+    vector<unsigned char> buckets;
+    int bucketStart[101] = {0};
+    for (int slot = 0; slot < snapshot.slots; slot++) {
+        const ProductVersion* version = snapshotVersion(snapshot, slot);
+        if (version == NULL) continue;
+        visible.push_back(version);
+        buckets.push_back(hashKey(makeProductKey(version->product.id)));
+        bucketStart[buckets.back() + 1]++;
+    }
+    for (int i = 0; i < 100; i++) bucketStart[i + 1] += bucketStart[i];
+    
+    vector<const ProductVersion*> rows(visible.size());
+    for (size_t i = 0; i < visible.size(); i++) rows[bucketStart[buckets[i]]++] = visible[i];
+    
+    for (size_t i = 0; i < rows.size(); i++) {
+        writeProductCSV(file, rows[i]->product);
+        if (!rows[i]->locations.empty()) file << "," << rows[i]->locations;
+        file << "\n";
+    }
+    return rows.size();
+}
+
+void saveToFile(string filename) {
+    TIME_OPERATION(OP_SAVE);
+    TraceScope trace(TRACE_SAVE);
+    if (trace.active) writeTraceString(filename);
+    if (filename.empty()) {
+        cout << "Error: Filename cannot be empty!\n";
+        return;
+    }
+    
+    ofstream file(filename);
+    if (!file) {
+        cout << "Error: Could not open file '" << filename << "' for writing!\n";
+        return;
+    }
+    
+    applyStockBatch();
+    
+    Snapshot snapshot;
+    if (!beginSnapshot(snapshot)) {
+        cout << "Error: Too many snapshots open, try again later!\n";
+        return;
+    }
+    int count = writeSnapshotRows(file, snapshot) + writeColdRows(file);
+    endSnapshot(snapshot);
+    
+    file.close();
+    if (file.fail()) {
+        cout << "Error: Failed to write to file!\n";
+        return;
+    }
+    
+    cout << "Successfully saved " << count << " products to " << filename << "\n";
+}
+
+// At most one save runs in the background at a time. Its result is
+// reported by finishBackgroundSave on the owning thread, which also
+// records its latency, since the histograms are not shared with workers.
+struct BackgroundSave {
+    thread worker;
+    atomic<bool> done;
+    string filename;
+    int count;
+    bool failed;
+    chrono::steady_clock::time_point start;
+    unsigned long long elapsedNs;  // from the request until the file was closed
+    
+    ~BackgroundSave() {
+        if (worker.joinable()) worker.join();
+    }
+};
+
+BackgroundSave backgroundSave;
+
+void runBackgroundSave(ofstream* file, Snapshot snapshot) {
+    int count = writeSnapshotRows(*file, snapshot);
+    endSnapshot(snapshot);
+    file->close();
+    backgroundSave.failed = file->fail();
+    delete file;
+    backgroundSave.count += count;
+    backgroundSave.elapsedNs = chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now() - backgroundSave.start).count();
+    backgroundSave.done.store(true, memory_order_release);
+}
+
+// Like saveToFile, but the catalog is written from a snapshot on another
+// thread, so the caller can keep changing it straight away. The rows of
+// the cold tier (if any) are still written synchronously, before this
+// returns: they are read through the page cache, which only the owning
+// thread may use.
+bool saveInBackground(string filename) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    TraceScope trace(TRACE_SAVE);
+    if (trace.active) writeTraceString(filename);
+    if (filename.empty()) {
+        cout << "Error: Filename cannot be empty!\n";
+        return false;
+    }
+    if (backgroundSave.worker.joinable()) {
+        cout << "Error: A save to '" << backgroundSave.filename << "' is still running!\n";
+        return false;
+    }
+    
+    ofstream* file = new ofstream(filename);
+    if (!*file) {
+        delete file;
+        cout << "Error: Could not open file '" << filename << "' for writing!\n";
+        return false;
+    }
+    
+    applyStockBatch();
+    
+    Snapshot snapshot;
+    if (!beginSnapshot(snapshot)) {
+        delete file;
+        cout << "Error: Too many snapshots open, try again later!\n";
+        return false;
+    }
+    backgroundSave.filename = filename;
+    backgroundSave.start = start;
+    backgroundSave.count = writeColdRows(*file);
+    backgroundSave.done.store(false, memory_order_relaxed);
+    backgroundSave.worker = thread(runBackgroundSave, file, snapshot);
+    return true;
+}
+
+// Reports the background save once it has finished (or, with wait, after
+// waiting for it). Returns false if there was nothing to report.
+bool finishBackgroundSave(bool wait, ostream& out) {
+    if (!backgroundSave.worker.joinable()) return false;
+    if (!wait && !backgroundSave.done.load(memory_order_acquire)) return false;
+    
+    backgroundSave.worker.join();
+#if INVENTORY_STATS
+    recordLatency(OP_SAVE, backgroundSave.elapsedNs);
+#endif
+    if (backgroundSave.failed) {
+        out << "Error: Failed to write to file '" << backgroundSave.filename << "'!\n";
+    } else {
+        out << "Successfully saved " << backgroundSave.count << " products to " << backgroundSave.filename << "\n";
+    }
+    return true;
+}
+
+void loadFromFile(string filename) {
+    TIME_OPERATION(OP_LOAD);
+    TraceScope trace(TRACE_LOAD);
+    if (trace.active) writeTraceString(filename);
+    if (filename.empty()) {
+        cout << "Error: Filename cannot be empty!\n";
+        return;
+    }
+    
+    ifstream file(filename);
+    if (!file) {
+        cout << "Error: Could not open file '" << filename << "' for reading!\n";
+        return;
+    }
+    
+    initSystem();
+    
+    string line;
+    int count = 0;
+    int lineNum = 0;
+    
+    while (getline(file, line)) {
+        lineNum++;
+        if (line.empty()) continue; // Skip empty lines
+        
+        Product p;
+        string error;
+        vector<LocationStock> locations;
+        if (parseProductCSV(line, p, error, &locations)) {
+            if (addProduct(p)) {
+                HashNode* node = findHashNode(p.id);
+                if (!locations.empty()) assignLocations(node, locations);
+                node->rowHash = hashRow(line);
+            }
+            count++;
+        } else {
+            cout << "Warning: Line " << lineNum << " " << error << ". Skipping...\n";
+        }
+    }
+    
+    file.close();
+    cout << "Successfully loaded " << count << " products from " << filename << "\n";
+}
+
+// True if the parsed row matches the product and its location split.
+bool sameProductContent(HashNode* node, const Product& p, vector<LocationStock> split) {
+    const Product& current = node->product;
+    if (current.name != p.name || current.category != p.category || current.price != p.price ||
+        current.rating != p.rating || current.stock != p.stock || current.sales != p.sales ||
+        current.reorderThreshold != p.reorderThreshold) {
+        return false;
+    }
+    
+    sort(split.begin(), split.end(), [](const LocationStock& a, const LocationStock& b) {
+        return a.location < b.location;
+    });
+    vector<LocationStock> wanted;
+    for (size_t i = 0; i < split.size(); i++) {
+        if (!wanted.empty() && wanted.back().location == split[i].location) {
+            wanted.back().quantity += split[i].quantity;
+        } else {
+            wanted.push_back(split[i]);
+        }
+    }
+    wanted.erase(remove_if(wanted.begin(), wanted.end(),
+                           [](const LocationStock& entry) { return entry.quantity == 0; }),
+                 wanted.end());
+    
+    vector<LocationStock> held;
+    if (node->locations != NULL) held = *node->locations;
+    else if (current.stock > 0) held.push_back({0, current.stock});
+    if (held.size() != wanted.size()) return false;
+    for (size_t i = 0; i < held.size(); i++) {
+        if (held[i].location != wanted[i].location || held[i].quantity != wanted[i].quantity) return false;
+    }
+    return true;
+}
+
+// ========== COLD TIER ==========
+// Moving products between memory and the cold store (see COLD STORAGE).
+
+// Only quiet products are evicted: none with sales history, reservations
+// or pending stock changes (that state lives in memory only), none below
+// their reorder threshold (so low-stock alerts stay complete), and none
+// whose ID or row is too long for a page.
+bool coldEvictable(HashNode* node) {
+    return node->series == NULL && node->counters.reserved == 0 && !node->counters.queued &&
+           node->product.stock >= node->product.reorderThreshold &&
+           (int)node->product.id.length() <= COLD_MAX_KEY;
+}
+
+string coldRowFor(HashNode* node) {
+    ostringstream row;
+    writeProductCSV(row, node->product);
+    if (node->locations != NULL) row << "," << formatLocations(node);
+    return row.str();
+}
+
+// Writes the product to the cold store and unlinks it from the in-memory
+// indexes. Warehouse totals and the sorted views keep counting it.
+bool evictProduct(HashNode* node, HashNode* prev, int bucket) {
+    ColdRecord record;
+    record.row = coldRowFor(node);
+    if ((int)record.row.size() > COLD_MAX_ROW) return false;
+    
+    // The sorted views find a paged-in product by its exact rating, so one
+    // that the row would round stays in memory.
+    ostringstream rating;
+    rating << node->product.rating;
+    if (stod(rating.str()) != node->product.rating) return false;
+    record.stamp = node->mergeStamp;
+    record.rowHash = node->rowHash;
+    coldInsert(record);
+    
+    if (prev == NULL) hashTable[bucket] = node->next;
+    else prev->next = node->next;
+    heapRemove(node);
+    setViewItem(node->product, NULL);
+    retireVersion(node);
+    bstRoot = deleteBSTAt(bstRoot, node->product.price, node->key, node->product.id);
+    freeHashNode(node);
+    residentProducts--;
+    coldStore.evictions++;
+    return true;
+}
+
+// One CLOCK round over the hash buckets: a product looked up since the
+// hand last passed it gets a second chance. Evicts down to 90% of the
+// limit so the sweep is not repeated on every add.
+void evictColdProducts() {
+    if (!coldStore.enabled || residentProducts <= max(coldStore.hotLimit, coldStore.evictAfter)) return;
+    
+    applyStockBatch();
+    int target = coldStore.hotLimit - coldStore.hotLimit / 10;
+    for (int scanned = 0; scanned < 100 && residentProducts > target; scanned++) {
+        int bucket = coldStore.evictBucket;
+        coldStore.evictBucket = (coldStore.evictBucket + 1) % 100;
+        
+        HashNode* prev = NULL;
+        HashNode* current = hashTable[bucket];
+        while (current != NULL && residentProducts > target) {
+            HashNode* next = current->next;
+            if (current->referenced.load(memory_order_relaxed)) {
+                current->referenced.store(false, memory_order_relaxed);
+                prev = current;
+            } else if (!coldEvictable(current) || !evictProduct(current, prev, bucket)) {
+                prev = current;
+            }
+            current = next;
+        }
+    }
+    
+    // Everything left was recently used or pinned; wait for more growth.
+    coldStore.evictAfter = residentProducts > coldStore.hotLimit ? residentProducts + coldStore.hotLimit / 10 + 1 : 0;
+}
+
+// Reads an evicted product's row without paging it in.
+bool readColdProduct(const string& id, Product& out) {
+    ColdRecord record;
+    string error;
+    return coldFind(id, record) && parseProductCSV(record.row, out, error);
+}
+
+// Pages an evicted product back into the in-memory indexes, or returns
+// NULL if it is not in the cold store either.
+HashNode* faultInProduct(const string& id) {
+    ColdRecord record;
+    if (!coldFind(id, record)) return NULL;
+    
+    Product p;
+    string error;
+    vector<LocationStock> locations;
+    if (!parseProductCSV(record.row, p, error, &locations)) return NULL;
+    coldErase(id);
+    
+    HashNode* node = linkProduct(p, true);
+    if (!locations.empty()) {
+        node->locations = new vector<LocationStock>(locations);
+        collapseLocations(node);
+        recordVersion(node);
+    }
+    node->rowHash = record.rowHash;
+    node->mergeStamp = record.stamp;
+    coldStore.faults++;
+    evictColdProducts();
+    return node;
+}
+
+// Evicted products priced within [minPrice, maxPrice], in ID order.
+void collectColdProducts(vector<Product>& out, Money minPrice, Money maxPrice) {
+    if (!coldStore.enabled) return;
+    
+    ColdLeaf leaf;
+    for (unsigned int page = coldFirstLeaf(); page != 0; page = leaf.next) {
+        readColdLeaf(page, leaf);
+        for (size_t i = 0; i < leaf.records.size(); i++) {
+            Product p;
+            string error;
+            if (parseProductCSV(leaf.records[i].row, p, error) && p.price >= minPrice && p.price <= maxPrice) {
+                out.push_back(p);
+            }
+        }
+    }
+}
+
+unsigned int mergeGeneration = 0;
+
+// Brings the live catalog in line with a full catalog file without a
+// reload: rows are matched by ID, rows whose hash equals the one recorded
+// when the product was last loaded or merged are skipped unparsed, and
+// only inserts, updates and deletes touch the indexes. Products missing
+// from the file are deleted; products with a malformed row are kept.
+void mergeFromFile(string filename) {
+    TIME_OPERATION(OP_MERGE);
+    TraceScope trace(TRACE_MERGE);
+    if (trace.active) writeTraceString(filename);
+    if (filename.empty()) {
+        cout << "Error: Filename cannot be empty!\n";
+        return;
+    }
+    
+    ifstream file(filename);
+    if (!file) {
+        cout << "Error: Could not open file '" << filename << "' for reading!\n";
+        return;
+    }
+    
+    applyStockBatch();
+    mergeGeneration++;
+    
+    string line;
+    int lineNum = 0;
+    int inserted = 0, updated = 0, unchanged = 0, failed = 0, deleted = 0;
+    
+    while (getline(file, line)) {
+        lineNum++;
+        if (line.empty()) continue;
+        
+        unsigned long long rowHash = hashRow(line);
+        string id = line.substr(0, line.find(','));
+        
+        // Unchanged evicted products are stamped on disk, not paged in.
+        HashNode* node = findResidentNode(id);
+        ColdRecord record;
+        if (node == NULL && coldStore.enabled && coldFind(id, record)) {
+            if (record.rowHash == rowHash || record.row == line) {
+                coldSetStamp(id, mergeGeneration);
+                unchanged++;
+                continue;
+            }
+            node = findHashNode(id);
+        }
+        if (node != NULL) {
+            node->mergeStamp = mergeGeneration;
+            if (node->rowHash == rowHash) {
+                unchanged++;
+                continue;
+            }
+        }
+        
+        Product p;
+        string error;
+        vector<LocationStock> locations;
+        if (!parseProductCSV(line, p, error, &locations)) {
+            cout << "Warning: Line " << lineNum << " " << error << ". Skipping...\n";
+            failed++;
+            continue;
+        }
+        if (locations.empty() && p.stock > 0) locations.push_back({0, p.stock});
+        
+        if (node == NULL) {
+            if (!addProduct(p)) {
+                failed++;
+                continue;
+            }
+            node = findHashNode(p.id);
+            assignLocations(node, locations);
+            inserted++;
+        } else if (sameProductContent(node, p, locations)) {
+            unchanged++;
+        } else {
+            if (!updateProduct(p.id, p)) {
+                failed++;
+                continue;
+            }
+            assignLocations(node, locations);
+            updated++;
+        }
+        
+        node->mergeStamp = mergeGeneration;
+        node->rowHash = rowHash;
+    }
+    file.close();
+    
+    vector<string> missing;
+    for (int i = 0; i < 100; i++) {
+        for (HashNode* current = hashTable[i]; current != NULL; current = current->next) {
+            if (current->mergeStamp != mergeGeneration) missing.push_back(current->product.id);
+        }
+    }
+    if (coldStore.enabled) {
+        ColdLeaf leaf;
+        for (unsigned int page = coldFirstLeaf(); page != 0; page = leaf.next) {
+            readColdLeaf(page, leaf);
+            for (size_t i = 0; i < leaf.records.size(); i++) {
+                if (leaf.records[i].stamp != mergeGeneration) missing.push_back(coldRowId(leaf.records[i].row));
+            }
+        }
+    }
+    for (size_t i = 0; i < missing.size(); i++) {
+        if (deleteProduct(missing[i])) deleted++;
+    }
+    
+    cout << "Merged " << filename << ": " << inserted << " inserted, " << updated << " updated, "
+         << deleted << " deleted, " << unchanged << " unchanged";
+    if (failed > 0) cout << ", " << failed << " failed";
+    cout << "\n";
+}
+
+// ========== QUERY SERVER ==========
+// A small line protocol so POS terminals and scanners can query the
+// inventory without the console menu. One command per line, one response
+// per command, in order, so clients may pipeline as many requests as they
+// like on a single connection:
+//
+//   PING                          -> OK PONG
+//   SEARCH <id>                   -> OK <csv row>       | ERR <reason>
+//   ADD <csv row>                 -> OK                 | ERR <reason>
+//   UPDATE <csv row>              -> OK                 | ERR <reason>
+//   DELETE <id>                   -> OK                 | ERR <reason>
+//   RANGE <min> <max>             -> ROWS <n> followed by n csv rows
+//   TOP <k> [price|rating|sales]  -> ROWS <n> followed by n csv rows
+//   RESERVE|RELEASE|COMMIT|SELL <id> <qty>
+//                                 -> OK                 | ERR <reason>
+//   STOCK <id>                    -> OK <available> <reserved>
+//   LOWSTOCK                      -> ROWS <n>, products below reorder threshold
+//   SOLD <id> <days>              -> OK <units sold> <units per day>
+//   MOVERS <k> <days>             -> ROWS <n> of "id,name,sold,previous window"
+//   STOCKAT <id> <days ago>       -> OK <stock then>    | ERR <reason>
+//   SAVE <file>                   -> OK SAVING          | ERR <reason>; the file
+//                                    is written from a snapshot in the background
+//   STATS                         -> ROWS <n> lines of the statistics report
+//   FEED                          -> OK <next sequence>
+//   FEED <seq> [max]              -> ROWS <n> followed by n "seq,type,row"
+//                                    change events (see CHANGE FEED)
+//   QUIT                          -> OK BYE, then the server closes
+//
+// Rows use the same format as saveToFile/loadFromFile.
+
+const int MAX_REQUEST_LINE = 64 * 1024;
+const size_t MAX_PENDING_OUTPUT = 1024 * 1024;
+
+// The core functions report errors on cout; while a request is running
+// cout is pointed at a buffer so the message can be sent back to the client.
+struct OutputCapture {
+    ostringstream buffer;
+    streambuf* saved;
+    
+    OutputCapture() { saved = cout.rdbuf(buffer.rdbuf()); }
+    ~OutputCapture() { cout.rdbuf(saved); }
+    
+    string firstLine() {
+        string text = buffer.str();
+        size_t end = text.find('\n');
+        if (end != string::npos) text = text.substr(0, end);
+        if (text.compare(0, 7, "Error: ") == 0) text = text.substr(7);
+        return text.empty() ? "Request failed" : text;
+    }
+};
+
+int sortFieldFromName(const string& name) {
+    if (name == "price") return 1;
+    if (name == "rating") return 2;
+    if (name == "sales" || name.empty()) return 3;
+    return 0;
+}
+
+// Parses a whole-number argument. Anything that is not a number in
+// [minValue, maxValue] is rejected before it can overflow, so a bad request
+// gets an ERR reply instead of an exception.
+bool parseIntArgument(const string& text, long long minValue, long long maxValue, long long& value) {
+    size_t start = (!text.empty() && text[0] == '-') ? 1 : 0;
+    if (start == text.length() || text.length() - start > 18) return false;
+    
+    value = 0;
+    for (size_t i = start; i < text.length(); i++) {
+        if (!isdigit((unsigned char)text[i])) return false;
+        value = value * 10 + (text[i] - '0');
+    }
+    if (start == 1) value = -value;
+    return value >= minValue && value <= maxValue;
+}
+
+bool parseIntArgument(const string& text, int minValue, int maxValue, int& value) {
+    long long parsed;
+    if (!parseIntArgument(text, (long long)minValue, (long long)maxValue, parsed)) return false;
+    value = (int)parsed;
+    return true;
+}
+
+// Top-k by the given sort field (1=price, 2=rating, else sales), highest first.
+void topProducts(int k, int sortBy, vector<Product>& out) {
+    applyStockBatch();
+    rankRange(sortBy, false, 1, k, out);
+}
+
+void appendRows(string& out, const vector<Product>& rows) {
+    ostringstream response;
+    response << "ROWS " << rows.size() << "\n";
+    for (size_t i = 0; i < rows.size(); i++) {
+        writeProductCSV(response, rows[i]);
+        response << "\n";
+    }
+    out += response.str();
+}
+
+// Executes one protocol line and appends its response to out.
+// Returns false when the client asked to close the connection.
+bool handleQueryCommand(const string& line, string& out) {
+    size_t space = line.find(' ');
+    string command = line.substr(0, space);
+    string args = (space == string::npos) ? "" : line.substr(space + 1);
+    for (size_t i = 0; i < command.length(); i++) {
+        command[i] = toupper(command[i]);
+    }
+    
+    if (command == "PING") {
+        out += "OK PONG\n";
+    } else if (command == "SEARCH") {
+        OutputCapture capture;
+        Product* p = searchProduct(args);
+        if (p != NULL) {
+            ostringstream response;
+            response << "OK ";
+            writeProductCSV(response, *p);
+            response << "\n";
+            out += response.str();
+        } else if (isValidProductID(args)) {
+            out += "ERR Product not found!\n";
+        } else {
+            out += "ERR " + capture.firstLine() + "\n";
+        }
+    } else if (command == "ADD" || command == "UPDATE") {
+        Product p;
+        string error;
+        vector<LocationStock> locations;
+        if (!parseProductCSV(args, p, error, &locations)) {
+            out += "ERR Row " + error + "\n";
+            return true;
+        }
+        
+        OutputCapture capture;
+        bool ok = (command == "ADD") ? addProduct(p) : updateProduct(p.id, p);
+        if (ok && !locations.empty()) assignLocations(findHashNode(p.id), locations);
+        out += ok ? "OK\n" : "ERR " + capture.firstLine() + "\n";
+    } else if (command == "DELETE") {
+        OutputCapture capture;
+        bool ok = deleteProduct(args);
+        out += ok ? "OK\n" : "ERR " + capture.firstLine() + "\n";
+    } else if (command == "RANGE") {
+        istringstream in(args);
+        string minText, maxText;
+        Money minPrice, maxPrice;
+        in >> minText >> maxText;
+        if (!parseMoney(minText, minPrice) || !parseMoney(maxText, maxPrice)) {
+            out += "ERR Usage: RANGE <min> <max>\n";
+            return true;
+        }
+
+        if (minPrice < 0 || maxPrice < 0) {
+            out += "ERR Prices cannot be negative!\n";
+        } else if (minPrice > maxPrice) {
+            out += "ERR Minimum price cannot be greater than maximum price!\n";
+        } else {
+            const vector<Product>* rows;
+            {
+                TIME_OPERATION(OP_RANGE);
+                TraceScope trace(TRACE_RANGE);
+                if (trace.active) {
+                    writeTraceInt(minPrice);
+                    writeTraceInt(maxPrice);
+                }
+                applyStockBatch();
+                rows = &cachedRange(minPrice, maxPrice);
+            }
+            appendRows(out, *rows);
+        }
+    } else if (command == "TOP") {
+        istringstream in(args);
+        string countText, field;
+        in >> countText >> field;
+        int sortBy = sortFieldFromName(field);
+        int count;
+        if (!parseIntArgument(countText, 0, INT_MAX, count) || sortBy == 0) {
+            out += "ERR Usage: TOP <k> [price|rating|sales]\n";
+            return true;
+        }
+        
+        vector<Product> rows;
+        topProducts(count, sortBy, rows);
+        appendRows(out, rows);
+    } else if (command == "RANK") {
+        istringstream in(args);
+        string id, field, order;
+        in >> id >> field >> order;
+        int sortBy = sortFieldFromName(field);
+        bool ascending;
+        if (id.empty() || sortBy == 0 || !parseSortOrder(order, ascending)) {
+            out += "ERR Usage: RANK <id> [price|rating|sales] [asc|desc]\n";
+            return true;
+        }
+        
+        applyStockBatch();
+        int rank = productRank(id, sortBy, ascending);
+        out += rank > 0 ? "OK " + to_string(rank) + "\n" : "ERR Product not found!\n";
+    } else if (command == "PAGE" || command == "RANKS") {
+        // PAGE <page> <size> or RANKS <from> <to>, both 1-based.
+        istringstream in(args);
+        string firstText, secondText, field, order;
+        in >> firstText >> secondText >> field >> order;
+        int sortBy = sortFieldFromName(field);
+        bool ascending;
+        int first, second;
+        if (!parseIntArgument(firstText, INT_MIN, INT_MAX, first) ||
+            !parseIntArgument(secondText, INT_MIN, INT_MAX, second) || sortBy == 0 || !parseSortOrder(order, ascending)) {
+            out += command == "PAGE" ? "ERR Usage: PAGE <page> <size> [price|rating|sales] [asc|desc]\n"
+                                     : "ERR Usage: RANKS <from> <to> [price|rating|sales] [asc|desc]\n";
+            return true;
+        }
+        
+        applyStockBatch();
+        vector<Product> rows;
+        if (command == "PAGE") sortedPage(sortBy, ascending, first, second, rows);
+        else rankRange(sortBy, ascending, first, second, rows);
+        appendRows(out, rows);
+    } else if (command == "RESERVE" || command == "RELEASE" ||
+               command == "COMMIT" || command == "SELL") {
+        istringstream in(args);
+        string id, quantityText;
+        in >> id >> quantityText;
+        int quantity;
+        if (!parseIntArgument(quantityText, INT_MIN, INT_MAX, quantity)) {
+            out += "ERR Usage: " + command + " <id> <qty>\n";
+            return true;
+        }
+        
+        OutputCapture capture;
+        bool ok;
+        if (command == "RESERVE") ok = reserveStock(id, quantity);
+        else if (command == "RELEASE") ok = releaseStock(id, quantity);
+        else if (command == "COMMIT") ok = commitStock(id, quantity);
+        else ok = incrementSales(id, quantity);
+        out += ok ? "OK\n" : "ERR " + capture.firstLine() + "\n";
+    } else if (command == "STOCK") {
+        HashNode* node = findHashNode(args);
+        if (node == NULL) {
+            out += "ERR Product not found!\n";
+        } else {
+            ostringstream response;
+            response << "OK " << node->counters.available << " " << node->counters.reserved << "\n";
+            out += response.str();
+        }
+    } else if (command == "LOWSTOCK") {
+        vector<Product> rows;
+        applyStockBatch();
+        lowStockProducts(rows);
+        appendRows(out, rows);
+    } else if (command == "SOLD" || command == "MOVERS") {
+        istringstream in(args);
+        string first, daysText;
+        in >> first >> daysText;
+        int days, count = 0;
+        if (!parseIntArgument(daysText, 1, INT_MAX, days) ||
+            (command == "MOVERS" && !parseIntArgument(first, 0, INT_MAX, count))) {
+            out += command == "SOLD" ? "ERR Usage: SOLD <id> <days>\n" : "ERR Usage: MOVERS <k> <days>\n";
+            return true;
+        }
+        long long window = days * SECONDS_PER_DAY;
+        
+        ostringstream response;
+        if (command == "SOLD") {
+            HashNode* node = findHashNode(first);
+            if (node == NULL) {
+                out += "ERR Product not found!\n";
+                return true;
+            }
+            response << "OK " << unitsSold(node, window) << " " << fixed << setprecision(2)
+                     << salesRate(node, window) << "\n";
+        } else {
+            vector<MoverEntry> movers;
+            topMovers(count, window, movers);
+            response << "ROWS " << movers.size() << "\n";
+            for (size_t i = 0; i < movers.size(); i++) {
+                response << movers[i].id << "," << movers[i].name << ","
+                         << movers[i].sold << "," << movers[i].previous << "\n";
+            }
+        }
+        out += response.str();
+    } else if (command == "STOCKAT") {
+        istringstream in(args);
+        string id, daysText;
+        in >> id >> daysText;
+        int days;
+        if (!parseIntArgument(daysText, 0, INT_MAX, days)) {
+            out += "ERR Usage: STOCKAT <id> <days ago>\n";
+            return true;
+        }
+        
+        applyStockBatch();
+        HashNode* node = findHashNode(id);
+        if (node == NULL) {
+            out += "ERR Product not found!\n";
+            return true;
+        }
+        int stock = stockAt(node, currentTimeSeconds() - days * SECONDS_PER_DAY);
+        out += stock >= 0 ? "OK " + to_string(stock) + "\n" : "ERR No stock history that far back\n";
+    } else if (command == "PLACE" || command == "MOVE") {
+        // PLACE <id> <location> <qty> sets the stock held there;
+        // MOVE <id> <from> <to> <qty> transfers between locations.
+        istringstream in(args);
+        string id, from, to, quantityText;
+        in >> id >> from;
+        if (command == "MOVE") in >> to;
+        in >> quantityText;
+        int quantity;
+        if (!parseIntArgument(quantityText, INT_MIN, INT_MAX, quantity)) {
+            out += command == "PLACE" ? "ERR Usage: PLACE <id> <location> <qty>\n"
+                                      : "ERR Usage: MOVE <id> <from> <to> <qty>\n";
+            return true;
+        }
+        
+        OutputCapture capture;
+        bool ok = command == "PLACE" ? setLocationStock(id, from, quantity)
+                                     : moveStock(id, from, to, quantity);
+        out += ok ? "OK\n" : "ERR " + capture.firstLine() + "\n";
+    } else if (command == "WHERE") {
+        vector<LocationStock> locations;
+        if (!productLocations(args, locations)) {
+            out += "ERR Product not found!\n";
+            return true;
+        }
+        
+        ostringstream response;
+        response << "ROWS " << locations.size() << "\n";
+        for (size_t i = 0; i < locations.size(); i++) {
+            response << locationNames[locations[i].location] << "," << locations[i].quantity << "\n";
+        }
+        out += response.str();
+    } else if (command == "WAREHOUSE") {
+        int location = findLocation(args);
+        if (location < 0) {
+            out += "ERR Unknown location!\n";
+            return true;
+        }
+        applyStockBatch();
+        out += "OK " + to_string(locationUnits[location]) + " " + formatMoney(locationValue[location]) + "\n";
+    } else if (command == "SAVE") {
+        OutputCapture capture;
+        bool ok = saveInBackground(args);
+        out += ok ? "OK SAVING\n" : "ERR " + capture.firstLine() + "\n";
+    } else if (command == "STATS") {
+        ostringstream report;
+        writeStats(report);
+        string text = report.str();
+        int lines = count(text.begin(), text.end(), '\n');
+        ostringstream response;
+        response << "ROWS " << lines << "\n" << text;
+        out += response.str();
+    } else if (command == "FEED") {
+        istringstream in(args);
+        string sequenceText, maxText;
+        in >> sequenceText >> maxText;
+        if (sequenceText.empty()) {
+            ostringstream response;
+            response << "OK " << feedPublished.load() << "\n";
+            out += response.str();
+            return true;
+        }
+        long long sequence;
+        int maxEvents = 1000;
+        if (!parseIntArgument(sequenceText, 0LL, LLONG_MAX, sequence) ||
+            (!maxText.empty() && !parseIntArgument(maxText, 0, INT_MAX, maxEvents))) {
+            out += "ERR Usage: FEED [<seq> [max]]\n";
+            return true;
+        }
+        
+        vector<ChangeEvent> events;
+        if (!readChangesSince(sequence, events, maxEvents)) {
+            out += "ERR Sequence is no longer buffered, reload the catalog\n";
+            return true;
+        }
+        
+        ostringstream response;
+        response << "ROWS " << events.size() << "\n";
+        for (size_t i = 0; i < events.size(); i++) {
+            response << events[i].sequence << "," << events[i].type;
+            if (events[i].type != 'C') {
+                response << ",";
+                writeProductCSV(response, events[i].product);
+            }
+            response << "\n";
+        }
+        out += response.str();
+    } else if (command == "QUIT") {
+        out += "OK BYE\n";
+        return false;
+    } else {
+        out += "ERR Unknown command '" + command + "'\n";
+    }
+    return true;
+}
+
+#ifdef __linux__
+struct ClientConnection {
+    int fd;
+    string in;
+    string out;
+    size_t outPos;
+    bool closing;
+    bool writing;
+};
+
+volatile sig_atomic_t serverRunning = 1;
+
+void stopServer(int) {
+    serverRunning = 0;
+}
+
+bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Addresses are "unix:<path>", "tcp:<port>" or a bare port; TCP is
+// always bound to localhost.
+int openSocket(const string& address, bool listening) {
+    int fd;
+    int result;
+    
+    if (address.compare(0, 5, "unix:") == 0) {
+        string path = address.substr(5);
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (path.empty() || path.length() >= sizeof(addr.sun_path)) {
+            cerr << "Error: Invalid socket path '" << path << "'!\n";
+            return -1;
+        }
+        strcpy(addr.sun_path, path.c_str());
+        
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        if (listening) {
+            unlink(path.c_str());
+            result = bind(fd, (sockaddr*)&addr, sizeof(addr));
+        } else {
+            result = connect(fd, (sockaddr*)&addr, sizeof(addr));
+        }
+    } else {
+        string portText = address.compare(0, 4, "tcp:") == 0 ? address.substr(4) : address;
+        if (!isValidIntInput(portText) || stoi(portText) <= 0 || stoi(portText) > 65535) {
+            cerr << "Error: Invalid port '" << portText << "'!\n";
+            return -1;
+        }
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(stoi(portText));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        int one = 1;
+        if (listening) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            result = bind(fd, (sockaddr*)&addr, sizeof(addr));
+        } else {
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            result = connect(fd, (sockaddr*)&addr, sizeof(addr));
+        }
+    }
+    
+    if (result == 0 && listening) {
+        result = listen(fd, 128);
+    }
+    if (result != 0) {
+        cerr << "Error: Could not " << (listening ? "listen on " : "connect to ")
+             << address << ": " << strerror(errno) << "\n";
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void closeConnection(int epollFd, map<int, ClientConnection>& connections, int fd) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+    close(fd);
+    connections.erase(fd);
+}
+
+// Writes as much pending output as the socket accepts.
+// Returns false if the connection failed.
+bool flushConnection(ClientConnection& conn) {
+    while (conn.outPos < conn.out.size()) {
+        ssize_t n = write(conn.fd, conn.out.data() + conn.outPos, conn.out.size() - conn.outPos);
+        if (n > 0) {
+            conn.outPos += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        } else {
+            return false;
+        }
+    }
+    conn.out.clear();
+    conn.outPos = 0;
+    return true;
+}
+
+// Runs every complete line in the input buffer. Stops early once enough
+// output is queued so a slow reader cannot make the server buffer without bound.
+void processRequests(ClientConnection& conn) {
+    size_t start = 0;
+    while (!conn.closing && conn.out.size() - conn.outPos < MAX_PENDING_OUTPUT) {
+        size_t end = conn.in.find('\n', start);
+        if (end == string::npos) break;
+        
+        string line = conn.in.substr(start, end - start);
+        if (!line.empty() && line[line.length() - 1] == '\r') {
+            line.erase(line.length() - 1);
+        }
+        start = end + 1;
+        
+        if (line.empty()) continue;
+        if (!handleQueryCommand(line, conn.out)) {
+            conn.closing = true;
+        }
+    }
+    conn.in.erase(0, start);
+}
+
+// Level-triggered interest: stop reading while output is backed up,
+// and only ask for writability while there is something to write.
+void updateInterest(int epollFd, ClientConnection& conn) {
+    bool pending = conn.outPos < conn.out.size();
+    epoll_event event;
+    event.data.fd = conn.fd;
+    event.events = 0;
+    if (!conn.closing && conn.out.size() - conn.outPos < MAX_PENDING_OUTPUT) event.events |= EPOLLIN;
+    if (pending) event.events |= EPOLLOUT;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, conn.fd, &event);
+    conn.writing = pending;
+}
+
+void logLowStockAlert(const Product& p) {
+    cerr << "Low stock: " << p.id << " stock " << p.stock
+         << " below threshold " << p.reorderThreshold << "\n";
+}
+
+int runQueryServer(const string& address) {
+    int listenFd = openSocket(address, true);
+    if (listenFd < 0) return 1;
+    setNonBlocking(listenFd);
+    
+    int epollFd = epoll_create1(0);
+    if (epollFd < 0) {
+        cerr << "Error: epoll_create1 failed: " << strerror(errno) << "\n";
+        close(listenFd);
+        return 1;
+    }
+    
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = listenFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+    
+    signal(SIGINT, stopServer);
+    signal(SIGTERM, stopServer);
+    signal(SIGPIPE, SIG_IGN);
+    setLowStockCallback(logLowStockAlert);
+    
+    cerr << "Inventory query server listening on " << address << " (Ctrl+C to stop)\n";
+    
+    // INVENTORY_STATS_INTERVAL=<seconds> dumps the statistics report to stderr periodically.
+    const char* intervalText = getenv("INVENTORY_STATS_INTERVAL");
+    int statsInterval = intervalText != NULL ? atoi(intervalText) : 0;
+    chrono::steady_clock::time_point nextDump = chrono::steady_clock::now() + chrono::seconds(statsInterval);
+    
+    map<int, ClientConnection> connections;
+    epoll_event events[64];
+    char buffer[64 * 1024];
+    
+    while (serverRunning) {
+        finishBackgroundSave(false, cerr);
+        int timeout = backgroundSave.worker.joinable() ? 100 : -1;
+        if (statsInterval > 0) {
+            chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            if (now >= nextDump) {
+                cerr << "\n=== OPERATION STATISTICS ===\n";
+                writeStats(cerr);
+                nextDump = now + chrono::seconds(statsInterval);
+            }
+            int untilDump = chrono::duration_cast<chrono::milliseconds>(nextDump - now).count() + 1;
+            timeout = timeout < 0 ? untilDump : min(timeout, untilDump);
+        }
+        
+        int ready = epoll_wait(epollFd, events, 64, timeout);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            cerr << "Error: epoll_wait failed: " << strerror(errno) << "\n";
+            break;
+        }
+        
+        for (int i = 0; i < ready; i++) {
+            int fd = events[i].data.fd;
+            
+            if (fd == listenFd) {
+                while (true) {
+                    int clientFd = accept(listenFd, NULL, NULL);
+                    if (clientFd < 0) break;
+                    setNonBlocking(clientFd);
+                    
+                    ClientConnection conn;
+                    conn.fd = clientFd;
+                    conn.outPos = 0;
+                    conn.closing = false;
+                    conn.writing = false;
+                    connections[clientFd] = conn;
+                    
+                    epoll_event clientEvent;
+                    clientEvent.events = EPOLLIN;
+                    clientEvent.data.fd = clientFd;
+                    epoll_ctl(epollFd, EPOLL_CTL_ADD, clientFd, &clientEvent);
+                }
+                continue;
+            }
+            
+            map<int, ClientConnection>::iterator it = connections.find(fd);
+            if (it == connections.end()) continue;
+            ClientConnection& conn = it->second;
+            bool alive = true;
+            
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                while (true) {
+                    ssize_t n = read(fd, buffer, sizeof(buffer));
+                    if (n > 0) {
+                        conn.in.append(buffer, n);
+                        if (conn.in.size() >= MAX_PENDING_OUTPUT) break;
+                    } else if (n < 0 && errno == EINTR) {
+                        continue;
+                    } else {
+                        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                            conn.closing = true;
+                        }
+                        break;
+                    }
+                }
+            }
+            
+            // Keep going while the socket drains as fast as we produce, so
+            // lines held back by the output limit are not left waiting for input.
+            while (true) {
+                processRequests(conn);
+                if (!flushConnection(conn)) {
+                    alive = false;
+                    break;
+                }
+                if (conn.closing || conn.outPos < conn.out.size() ||
+                    conn.in.find('\n') == string::npos) {
+                    break;
+                }
+            }
+            if (conn.in.size() > (size_t)MAX_REQUEST_LINE && conn.in.find('\n') == string::npos) {
+                conn.closing = true;
+            }
+            if (alive && conn.closing && conn.outPos >= conn.out.size()) {
+                alive = false;
+            }
+            
+            if (alive) {
+                updateInterest(epollFd, conn);
+            } else {
+                closeConnection(epollFd, connections, fd);
+            }
+        }
+        
+        // Committed sales from this round are folded into the catalog together.
+        applyStockBatch();
+    }
+    
+    while (!connections.empty()) {
+        closeConnection(epollFd, connections, connections.begin()->first);
+    }
+    close(epollFd);
+    close(listenFd);
+    finishBackgroundSave(true, cerr);
+    if (address.compare(0, 5, "unix:") == 0) {
+        unlink(address.substr(5).c_str());
+    }
+    cerr << "Query server stopped.\n";
+    return 0;
+}
+
+// ========== LOAD GENERATOR ==========
+// Reads one complete response (a single line, or a ROWS header plus rows).
+bool readResponse(int fd, string& buffer, size_t& pos) {
+    int rowsLeft = -1;
+    char chunk[64 * 1024];
+    
+    while (true) {
+        size_t end = buffer.find('\n', pos);
+        if (end == string::npos) {
+            buffer.erase(0, pos);
+            pos = 0;
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            buffer.append(chunk, n);
+            continue;
+        }
+        
+        if (rowsLeft < 0) {
+            if (buffer.compare(pos, 5, "ROWS ") == 0) {
+                rowsLeft = atoi(buffer.c_str() + pos + 5);
+            } else {
+                rowsLeft = 0;
+            }
+        } else {
+            rowsLeft--;
+        }
+        pos = end + 1;
+        if (rowsLeft == 0) return true;
+    }
+}
+
+bool sendAll(int fd, const string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+// Seeds catalogSize products, then sends totalRequests requests in pipelined
+// batches of pipelineDepth (90% SEARCH, 5% UPDATE, 5% narrow RANGE) and
+// reports throughput and latency percentiles.
+int runLoadGenerator(const string& address, int totalRequests, int pipelineDepth, int catalogSize) {
+    int fd = openSocket(address, false);
+    if (fd < 0) return 1;
+    
+    string buffer;
+    size_t pos = 0;
+    
+    for (int i = 0; i < catalogSize; i += pipelineDepth) {
+        string batch;
+        int batchSize = min(pipelineDepth, catalogSize - i);
+        for (int j = 0; j < batchSize; j++) {
+            ostringstream request;
+            request << "ADD LG" << (i + j) << ",Load Product " << (i + j) << ",LoadGen,"
+                    << ((i + j) % 1000) << ".99," << ((i + j) % 50) / 10.0 << ","
+                    << (i + j) % 500 << "," << (i + j) % 300 << "\n";
+            batch += request.str();
+        }
+        if (!sendAll(fd, batch)) {
+            cerr << "Error: Connection lost while seeding catalog!\n";
+            close(fd);
+            return 1;
+        }
+        for (int j = 0; j < batchSize; j++) {
+            if (!readResponse(fd, buffer, pos)) {
+                cerr << "Error: Connection lost while seeding catalog!\n";
+                close(fd);
+                return 1;
+            }
+        }
+    }
+    
+    vector<double> latencies;
+    latencies.reserve(totalRequests);
+    unsigned int seed = 12345;
+    
+    chrono::steady_clock::time_point started = chrono::steady_clock::now();
+    for (int i = 0; i < totalRequests; i += pipelineDepth) {
+        string batch;
+        int batchSize = min(pipelineDepth, totalRequests - i);
+        for (int j = 0; j < batchSize; j++) {
+            seed = seed * 1103515245 + 12345;
+            int id = (seed >> 8) % max(catalogSize, 1);
+            int kind = (seed >> 4) % 20;
+            ostringstream request;
+            if (kind == 0) {
+                request << "UPDATE LG" << id << ",Load Product " << id << ",LoadGen,"
+                        << (id % 1000) << ".99,4.0," << (seed % 500) << "," << id % 300 << "\n";
+            } else if (kind == 1) {
+                request << "RANGE " << (id % 1000) << " " << (id % 1000) + 0.5 << "\n";
+            } else {
+                request << "SEARCH LG" << id << "\n";
+            }
+            batch += request.str();
+        }
+        
+        chrono::steady_clock::time_point batchStart = chrono::steady_clock::now();
+        if (!sendAll(fd, batch)) {
+            cerr << "Error: Connection lost during load test!\n";
+            close(fd);
+            return 1;
+        }
+        for (int j = 0; j < batchSize; j++) {
+            if (!readResponse(fd, buffer, pos)) {
+                cerr << "Error: Connection lost during load test!\n";
+                close(fd);
+                return 1;
+            }
+            chrono::duration<double, micro> latency = chrono::steady_clock::now() - batchStart;
+            latencies.push_back(latency.count());
+        }
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - started;
+    close(fd);
+    
+    if (latencies.empty()) {
+        cout << "No requests sent.\n";
+        return 0;
+    }
+    
+    sort(latencies.begin(), latencies.end());
+    size_t n = latencies.size();
+    cout << "\n=== LOAD TEST RESULTS ===\n";
+    cout << "Requests:       " << n << " (pipeline depth " << pipelineDepth << ")\n";
+    cout << "Elapsed:        " << fixed << setprecision(3) << elapsed.count() << " s\n";
+    cout << "Throughput:     " << fixed << setprecision(0) << n / elapsed.count() << " req/s\n";
+    cout << "Latency p50:    " << fixed << setprecision(1) << latencies[n / 2] << " us\n";
+    cout << "Latency p99:    " << latencies[min(n - 1, n * 99 / 100)] << " us\n";
+    cout << "Latency max:    " << latencies[n - 1] << " us\n";
+    return 0;
+}
+#endif
+
+// ========== BENCHMARK ==========
+// Deterministic synthetic catalogs and timings for every core path, written
+// as JSON so results can be compared between releases:
+//
+//   ./inventory --bench sizes=1000,10000,100000 order=random prices=uniform
+//                       distinct=0 seed=42 out=bench_results.json
+//
+// order:    random | sorted | reverse | zigzag (all but random turn the
+//           price BST into a chain)
+// prices:   uniform (1-1000) | skewed (log-uniform, mostly cheap items)
+// distinct: if > 0, only this many distinct prices, ratings and sales values
+
+struct CatalogSpec {
+    int size;
+    string order;
+    string prices;
+    int distinct;
+    unsigned long long seed;
+};
+
+struct BenchResult {
+    string op;
+    long long count;
+    double totalMs;
+    int statsOp;  // OperationKind for percentiles, or -1
+};
+
+// Degenerate price orders make every BST insert walk (and recurse through)
+// the whole tree, so they are only run up to this size.
+const int MAX_DEGENERATE_BENCH_SIZE = 20000;
+
+struct NullBuffer : streambuf {
+    int overflow(int c) { return c; }
+};
+
+// xorshift64*, so catalogs are identical on every platform and library.
+unsigned long long nextRandom(unsigned long long& state) {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 2685821657736338717ULL;
+}
+
+double randomUnit(unsigned long long& state) {
+    return (nextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Vocabulary for catalog names, so they have realistic lengths and shared
+// prefixes ("Northwind Mechanical Keyboard Pro 512 Silver").
+const char* const BENCH_BRANDS[] = {"Acme", "Northwind", "Contoso", "Globex", "Initech", "Umbrella", "Fabrikam", "Tailspin"};
+const char* const BENCH_ITEMS[] = {
+    "Wireless Headphones", "Mechanical Keyboard", "Gaming Mouse", "USB-C Charger", "Smart Watch",
+    "Bluetooth Speaker", "Laptop Stand", "Desk Lamp", "Coffee Grinder", "Water Bottle",
+    "Running Shoes", "Yoga Mat", "Backpack", "Office Chair", "Monitor Arm",
+    "Webcam", "External SSD", "Phone Case", "Travel Mug", "Air Purifier"};
+const char* const BENCH_LINES[] = {"Pro", "Max", "Lite", "Plus", "Ultra", "Classic"};
+const char* const BENCH_COLORS[] = {"Black", "White", "Silver", "Blue", "Red", "Green"};
+const char* const BENCH_CATEGORIES[] = {
+    "Audio", "Computer Accessories", "Computer Accessories", "Power & Charging", "Wearables",
+    "Audio", "Computer Accessories", "Home & Office", "Kitchen", "Outdoor",
+    "Sportswear", "Fitness", "Bags & Luggage", "Home & Office", "Computer Accessories",
+    "Computer Accessories", "Storage", "Phone Accessories", "Kitchen", "Home Appliances"};
+
+// Heap bytes currently allocated, or 0 where the C library does not say.
+long long heapBytesInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 info = mallinfo2();
+    return (long long)(info.uordblks + info.hblkhd);
+#else
+    return 0;
+#endif
+}
+
+void generateCatalog(const CatalogSpec& spec, vector<Product>& out) {
+    unsigned long long state = spec.seed * 0x9E3779B97F4A7C15ULL + 1;
+    out.clear();
+    out.reserve(spec.size);
+    
+    for (int i = 0; i < spec.size; i++) {
+        Product p;
+        ostringstream id;
+        id << "SKU" << setw(8) << setfill('0') << i;
+        p.id = id.str();
+        // Names come from their own stream so prices and sales match
+        // catalogs generated before names had a vocabulary.
+        unsigned long long nameState = state ^ ((unsigned long long)(i + 1) * 0xD1B54A32D192ED03ULL);
+        int item = nextRandom(state) % 20;
+        p.name = string(BENCH_BRANDS[nextRandom(nameState) % 8]) + " " + BENCH_ITEMS[item] + " " +
+                 BENCH_LINES[nextRandom(nameState) % 6] + " " + to_string(100 + nextRandom(nameState) % 900) + " " +
+                 BENCH_COLORS[nextRandom(nameState) % 6];
+        p.category = BENCH_CATEGORIES[item];
+        
+        double u = randomUnit(state);
+        if (spec.distinct > 0) {
+            u = (double)(nextRandom(state) % spec.distinct) / spec.distinct;
+        }
+        if (spec.prices == "skewed") {
+            p.price = (Money)(exp(u * log(100000.0)) * PRICE_SCALE / 100);
+        } else {
+            p.price = (Money)((1.0 + u * 999.0) * PRICE_SCALE);
+        }
+        
+        if (spec.distinct > 0) {
+            p.rating = (nextRandom(state) % spec.distinct) * 5.0 / spec.distinct;
+            p.sales = nextRandom(state) % spec.distinct;
+        } else {
+            p.rating = (nextRandom(state) % 51) / 10.0;
+            p.sales = nextRandom(state) % 100000;
+        }
+        p.stock = nextRandom(state) % 1000;
+        p.reorderThreshold = nextRandom(state) % 50;
+        out.push_back(p);
+    }
+    
+    if (spec.order == "sorted" || spec.order == "reverse" || spec.order == "zigzag") {
+        stable_sort(out.begin(), out.end(),
+                    [](const Product& a, const Product& b) { return a.price < b.price; });
+    }
+    if (spec.order == "reverse") {
+        reverse(out.begin(), out.end());
+    } else if (spec.order == "zigzag") {
+        // lowest, highest, second lowest, second highest, ...
+        vector<Product> zigzag;
+        zigzag.reserve(out.size());
+        int low = 0, high = out.size() - 1;
+        while (low <= high) {
+            zigzag.push_back(out[low++]);
+            if (low <= high) zigzag.push_back(out[high--]);
+        }
+        out.swap(zigzag);
+    }
+}
+
+double elapsedMs(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void writeBenchResultJSON(ostream& out, const BenchResult& r) {
+    out << "{\"op\": \"" << r.op << "\", \"count\": " << r.count
+        << ", \"total_ms\": " << fixed << setprecision(3) << r.totalMs
+        << ", \"ns_per_op\": " << setprecision(1) << (r.count > 0 ? r.totalMs * 1e6 / r.count : 0.0);
+#if INVENTORY_STATS
+    if (r.statsOp >= 0 && operationStats[r.statsOp].count > 0) {
+        const LatencyHistogram& h = operationStats[r.statsOp];
+        out << ", \"p50_ns\": " << histogramPercentile(h, 50)
+            << ", \"p99_ns\": " << histogramPercentile(h, 99)
+            << ", \"max_ns\": " << h.maxNs;
+    }
+#endif
+    out << "}";
+}
+
+// Runs every operation against one generated catalog and appends the JSON
+// object for this size to json.
+void benchmarkCatalog(const CatalogSpec& spec, ostream& json, const string& dataFile) {
+    vector<Product> catalog;
+    generateCatalog(spec, catalog);
+    int n = catalog.size();
+    unsigned long long state = spec.seed + n;
+    vector<BenchResult> results;
+    vector<string> skipped;
+    chrono::steady_clock::time_point start;
+    
+    initSystem();
+    resetStats();
+    
+    NullBuffer nullBuffer;
+    streambuf* console = cout.rdbuf(&nullBuffer);
+    
+    // Resident cost of the catalog: indexes, sorted views and undo copies.
+    long long heapBefore = heapBytesInUse();
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < n; i++) addProduct(catalog[i]);
+    results.push_back({"add", n, elapsedMs(start), OP_ADD});
+    int depthAfterAdd = bstDepth(bstRoot);
+    double bytesPerProduct = (double)(heapBytesInUse() - heapBefore) / n;
     
-    if (!isValidPrice(newProduct.price)) {
-        cout << "Error: Price must be non-negative!\n";
-        return;
+    int lookups = min(n, 100000);
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < lookups; i++) {
+        searchProduct(catalog[nextRandom(state) % n].id);
     }
+    results.push_back({"search", lookups, elapsedMs(start), OP_SEARCH});
     
-    if (!isValidRating(newProduct.rating)) {
-        cout << "Error: Rating must be between 0.0 and 5.0!\n";
-        return;
+    int ranges = 1000;
+    vector<Product> rows;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < ranges; i++) {
+        Money low = catalog[nextRandom(state) % n].price;
+        rows.clear();
+        TIME_OPERATION(OP_RANGE);
+        collectRangeBST(bstRoot, low, low + low / 100 + 1, rows);
     }
+    results.push_back({"rangeSearch", ranges, elapsedMs(start), OP_RANGE});
     
-    if (!isValidStock(newProduct.stock)) {
-        cout << "Error: Stock must be non-negative!\n";
-        return;
+    // Price-changing updates move the product in the BST. Updates and
+    // deletes are timed on a sample of at most 1000 products.
+    int updates = min(n, 1000);
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < updates; i++) {
+        Product p = catalog[nextRandom(state) % n];
+        p.price = PRICE_SCALE + nextRandom(state) % (999 * PRICE_SCALE);
+        p.stock++;
+        updateProduct(p.id, p);
     }
+    results.push_back({"update", updates, elapsedMs(start), OP_UPDATE});
     
-    if (!isValidSales(newProduct.sales)) {
-        cout << "Error: Sales must be non-negative!\n";
-        return;
+    // Orders from several threads at once on the lock-free counters, while
+    // this thread folds the batches. Every unit must be accounted for after.
+    applyStockBatch();
+    vector<HashNode*> nodes;
+    long long stockBefore = 0, salesBefore = 0;
+    for (int i = 0; i < 100; i++) {
+        for (HashNode* current = hashTable[i]; current != NULL; current = current->next) {
+            nodes.push_back(current);
+            stockBefore += current->product.stock;
+            salesBefore += current->product.sales;
+        }
+    }
+    int workers = max(2, min(8, (int)thread::hardware_concurrency()));
+    int ordersPerWorker = min(n, 100000) / workers + 1;
+    atomic<long long> committedUnits(0), soldUnits(0);
+    atomic<int> running(workers);
+    vector<thread> threads;
+    start = chrono::steady_clock::now();
+    for (int w = 0; w < workers; w++) {
+        threads.push_back(thread([&, w]() {
+            unsigned long long local = state + w + 1;
+            long long committed = 0, sold = 0;
+            for (int i = 0; i < ordersPerWorker; i++) {
+                HashNode* node = nodes[nextRandom(local) % nodes.size()];
+                int quantity = 1 + nextRandom(local) % 3;
+                if (nextRandom(local) % 10 == 0) {
+                    sellUnits(node, quantity);
+                    sold += quantity;
+                } else if (reserveUnits(node, quantity)) {
+                    // Each worker only settles its own reservations, so
+                    // these cannot fail.
+                    if (nextRandom(local) % 3 == 0) releaseUnits(node, quantity);
+                    else if (commitUnits(node, quantity)) committed += quantity;
+                }
+            }
+            committedUnits += committed;
+            soldUnits += sold;
+            running--;
+        }));
     }
+    while (running > 0) {
+        applyStockBatch();
+        this_thread::yield();
+    }
+    for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+    applyStockBatch();
+    results.push_back({"reserve", workers * ordersPerWorker, elapsedMs(start), -1});
     
-    Product oldCopy = *oldProduct;
-    pushStack(undoStack, "UPDATE", newProduct, oldCopy);
+    long long stockAfter = 0, salesAfter = 0;
+    bool balanced = true;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const StockCounters& counters = nodes[i]->counters;
+        stockAfter += nodes[i]->product.stock;
+        salesAfter += nodes[i]->product.sales;
+        if (counters.reserved != 0 || counters.available != nodes[i]->product.stock) balanced = false;
+    }
+    if (!balanced || stockAfter != stockBefore - committedUnits ||
+        salesAfter != salesBefore + committedUnits + soldUnits) {
+        cerr << "Error: Concurrent reservations did not balance (stock " << stockBefore << " -> " << stockAfter
+             << ", " << committedUnits << " committed; sales " << salesBefore << " -> " << salesAfter
+             << ", " << soldUnits << " sold)!\n";
+    }
     
-    *oldProduct = newProduct;
+    Product* snapshot = new Product[n];
+    int copied = 0;
+    for (int i = 0; i < 100; i++) {
+        for (HashNode* current = hashTable[i]; current != NULL; current = current->next) {
+            snapshot[copied++] = current->product;
+        }
+    }
     
-    bstRoot = deleteBST(bstRoot, id);
-    bstRoot = insertBST(bstRoot, newProduct);
+    SortSpec byPrice = singleKeySpec(1, true);
+    start = chrono::steady_clock::now();
+    sortProductArray(snapshot, copied, byPrice, 1);
+    results.push_back({"mergeSort", copied, elapsedMs(start), OP_MERGE_SORT});
     
-    cout << "Product updated successfully!\n";
-}
-
-void deleteProduct(string id) {
-    if (!isValidProductID(id)) {
-        cout << "Error: Invalid Product ID!\n";
-        return;
+    // Lomuto partitioning with the last element as pivot is quadratic (and
+    // recurses n deep) on ordered or duplicate-heavy input.
+    bool quickSortDegenerates = spec.order != "random" || spec.distinct > 0;
+    if (quickSortDegenerates && copied > MAX_DEGENERATE_BENCH_SIZE) {
+        skipped.push_back("quickSort");
+    } else {
+        int filled = 0;
+        for (int i = 0; i < 100; i++) {
+            for (HashNode* current = hashTable[i]; current != NULL; current = current->next) {
+                snapshot[filled++] = current->product;
+            }
+        }
+        start = chrono::steady_clock::now();
+        sortProductArray(snapshot, copied, byPrice, 2);
+        results.push_back({"quickSort", copied, elapsedMs(start), OP_QUICK_SORT});
     }
+    delete[] snapshot;
     
-    int index = hashFunction(id);
-    HashNode* current = hashTable[index];
-    HashNode* prev = NULL;
+    start = chrono::steady_clock::now();
+    saveToFile(dataFile);
+    results.push_back({"save", 1, elapsedMs(start), OP_SAVE});
     
-    while (current != NULL) {
-        if (current->product.id == id) {
-            pushStack(undoStack, "DELETE", current->product, current->product);
-            
-            if (prev == NULL) {
-                hashTable[index] = current->next;
+    start = chrono::steady_clock::now();
+    loadFromFile(dataFile);
+    results.push_back({"load", 1, elapsedMs(start), OP_LOAD});
+    
+    // A nightly feed: the saved catalog with 1% of rows changed and 0.1%
+    // dropped, merged into the catalog that was just loaded.
+    string deltaFile = dataFile + ".delta";
+    {
+        ifstream saved(dataFile);
+        ofstream delta(deltaFile);
+        string line;
+        for (int row = 0; getline(saved, line); row++) {
+            if (row % 1000 == 999) continue;
+            Product p;
+            string error;
+            if (row % 100 == 0 && parseProductCSV(line, p, error)) {
+                p.stock++;
+                writeProductCSV(delta, p);
+                delta << "\n";
             } else {
-                prev->next = current->next;
+                delta << line << "\n";
             }
-            
-            bstRoot = deleteBST(bstRoot, id);
-            delete current;
-            
-            cout << "Product deleted successfully!\n";
-            return;
         }
-        prev = current;
-        current = current->next;
     }
-    cout << "Product not found!\n";
-}
-
-void displayAllProducts() {
-    cout << "\n=== ALL PRODUCTS ===\n";
-    cout << left << setw(8) << "ID";
-    cout << left << setw(25) << "Name";
-    cout << left << setw(20) << "Category";
-    cout << left << setw(12) << "Price";
-    cout << left << setw(8) << "Rating";
-    cout << left << setw(10) << "Stock";
-    cout << left << setw(8) << "Sales" << endl;
-    cout << string(90, '-') << endl;
+    start = chrono::steady_clock::now();
+    mergeFromFile(deltaFile);
+    results.push_back({"merge", 1, elapsedMs(start), OP_MERGE});
+    remove(deltaFile.c_str());
+    remove(dataFile.c_str());
     
-    int count = 0;
-    for (int i = 0; i < 100; i++) {
-        HashNode* current = hashTable[i];
-        while (current != NULL) {
-            Product p = current->product;
-            
-            cout << left << setw(8) << p.id;
-            cout << left << setw(25) << p.name;
-            cout << left << setw(20) << p.category;
-            cout << "$" << left << setw(11) << fixed << setprecision(2) << p.price;
-            cout << left << setw(8) << fixed << setprecision(1) << p.rating;
-            cout << left << setw(10) << p.stock;
-            cout << left << setw(8) << p.sales << endl;
-            
-            count++;
-            current = current->next;
-        }
+    int deletes = min(n, 1000);
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < deletes; i++) {
+        deleteProduct(catalog[nextRandom(state) % n].id);
     }
-    cout << string(90, '-') << endl;
-    cout << "Total Products: " << count << "\n";
-}
-
-void sortProducts(int sortBy, int algorithm, bool ascending) {
-    copyProductsToArray();
+    results.push_back({"delete", deletes, elapsedMs(start), OP_DELETE});
     
-    if (productCount == 0) {
-        cout << "No products to sort!\n";
-        return;
-    }
+    cout.rdbuf(console);
     
-    if (algorithm == 1) {
-        mergeSortProducts(productArray, 0, productCount - 1, sortBy, ascending);
-        cout << "\nSorted using Merge Sort:\n";
-    } else {
-        quickSortProducts(productArray, 0, productCount - 1, sortBy, ascending);
-        cout << "\nSorted using Quick Sort:\n";
+    json << "    {\"size\": " << n << ", \"bst_depth\": " << depthAfterAdd
+         << ", \"heap_bytes_per_product\": " << fixed << setprecision(1) << bytesPerProduct
+         << ", \"string_pool_bytes\": " << poolMemoryBytes() << ", \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        json << "      ";
+        writeBenchResultJSON(json, results[i]);
+        json << (i + 1 < results.size() ? ",\n" : "\n");
     }
-    
-    displayProducts(productArray, productCount);
-}
-
-void rangeSearch(double minPrice, double maxPrice) {
-    if (minPrice < 0 || maxPrice < 0) {
-        cout << "Error: Prices cannot be negative!\n";
-        return;
+    json << "    ], \"skipped\": [";
+    for (size_t i = 0; i < skipped.size(); i++) {
+        json << (i > 0 ? ", " : "") << "\"" << skipped[i] << "\"";
     }
+    json << "]}";
     
-    if (minPrice > maxPrice) {
-        cout << "Error: Minimum price cannot be greater than maximum price!\n";
-        return;
+    cout << "\nCatalog size " << n << " (" << fixed << setprecision(1) << bytesPerProduct << " heap bytes/product):\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        cout << "  " << left << setw(12) << results[i].op << right << setw(12) << fixed << setprecision(3)
+             << results[i].totalMs << " ms" << setw(14) << setprecision(1)
+             << results[i].totalMs * 1e6 / results[i].count << " ns/op\n";
+    }
+    for (size_t i = 0; i < skipped.size(); i++) {
+        cout << "  " << left << setw(12) << skipped[i] << "skipped (degenerate input at this size)\n";
     }
-    
-    cout << "\n=== PRODUCTS IN PRICE RANGE $" << minPrice << " to $" << maxPrice << " ===\n";
-    rangeSearchBST(bstRoot, minPrice, maxPrice);
 }
 
-void undoOperation() {
-    string op;
-    Product p, old;
+int runBenchmark(int argc, char* argv[]) {
+    CatalogSpec spec;
+    spec.order = "random";
+    spec.prices = "uniform";
+    spec.distinct = 0;
+    spec.seed = 42;
+    string sizesText = "1000,10000,100000";
+    string outFile = "bench_results.json";
+    int hotLimit = 0;
+    int cachePages = 256;
     
-    if (!popStack(undoStack, op, p, old)) {
-        cout << "Nothing to undo!\n";
-        return;
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        size_t eq = arg.find('=');
+        string key = arg.substr(0, eq);
+        string value = eq == string::npos ? "" : arg.substr(eq + 1);
+        
+        if (key == "sizes") sizesText = value;
+        else if (key == "order") spec.order = value;
+        else if (key == "prices") spec.prices = value;
+        else if (key == "distinct" && isValidIntInput(value)) spec.distinct = stoi(value);
+        else if (key == "seed" && isValidIntInput(value)) spec.seed = stoull(value);
+        else if (key == "out") outFile = value;
+        else if (key == "hot" && isValidIntInput(value) && stoi(value) > 0) hotLimit = stoi(value);
+        else if (key == "cache" && isValidIntInput(value) && stoi(value) > 0) cachePages = stoi(value);
+        else {
+            cerr << "Error: Unknown benchmark option '" << arg << "'!\n";
+            return 1;
+        }
     }
     
-    pushStack(redoStack, op, p, old);
-    
-    if (op == "ADD") {
-        deleteProduct(p.id);
-    } else if (op == "DELETE") {
-        addProduct(p);
-    } else if (op == "UPDATE") {
-        updateProduct(p.id, old);
+    if (spec.order != "random" && spec.order != "sorted" && spec.order != "reverse" && spec.order != "zigzag") {
+        cerr << "Error: order must be random, sorted, reverse or zigzag!\n";
+        return 1;
     }
-    
-    cout << "Undo operation completed!\n";
-}
-
-void redoOperation() {
-    string op;
-    Product p, old;
-    
-    if (!popStack(redoStack, op, p, old)) {
-        cout << "Nothing to redo!\n";
-        return;
+    if (spec.prices != "uniform" && spec.prices != "skewed") {
+        cerr << "Error: prices must be uniform or skewed!\n";
+        return 1;
     }
     
-    if (op == "ADD") {
-        addProduct(p);
-    } else if (op == "DELETE") {
-        deleteProduct(p.id);
-    } else if (op == "UPDATE") {
-        updateProduct(p.id, p);
+    vector<int> sizes;
+    stringstream sizeList(sizesText);
+    string sizeText;
+    while (getline(sizeList, sizeText, ',')) {
+        if (!isValidIntInput(sizeText) || stoi(sizeText) <= 0) {
+            cerr << "Error: Invalid catalog size '" << sizeText << "'!\n";
+            return 1;
+        }
+        sizes.push_back(stoi(sizeText));
     }
     
-    cout << "Redo operation completed!\n";
-}
-
-void saveToFile(string filename) {
-    if (filename.empty()) {
-        cout << "Error: Filename cannot be empty!\n";
-        return;
+    ofstream json(outFile);
+    if (!json) {
+        cerr << "Error: Could not open file '" << outFile << "' for writing!\n";
+        return 1;
     }
+    json << "{\n  \"benchmark\": \"inventory-track-pro\",\n"
+         << "  \"config\": {\"order\": \"" << spec.order << "\", \"prices\": \"" << spec.prices
+         << "\", \"distinct\": " << spec.distinct << ", \"seed\": " << spec.seed
+         << ", \"hot\": " << hotLimit << ", \"cache_pages\": " << cachePages
+         << ", \"stats\": " << (INVENTORY_STATS ? "true" : "false") << "},\n  \"runs\": [\n";
     
-    ofstream file(filename);
-    if (!file) {
-        cout << "Error: Could not open file '" << filename << "' for writing!\n";
-        return;
-    }
+    // hot=N runs every catalog with a cold store holding all but N products.
+    if (hotLimit > 0 && !openColdStore(outFile + ".cold", hotLimit, cachePages)) return 1;
     
-    int count = 0;
-    for (int i = 0; i < 100; i++) {
-        HashNode* current = hashTable[i];
-        while (current != NULL) {
-            Product p = current->product;
-            file << p.id << "," << p.name << "," << p.category << ","
-                 << p.price << "," << p.rating << "," 
-                 << p.stock << "," << p.sales << "\n";
-            count++;
-            current = current->next;
+    bool first = true;
+    for (size_t i = 0; i < sizes.size(); i++) {
+        spec.size = sizes[i];
+        if (spec.order != "random" && spec.size > MAX_DEGENERATE_BENCH_SIZE) {
+            cout << "\nCatalog size " << spec.size << ": skipped, " << spec.order
+                 << " order degenerates the price BST above " << MAX_DEGENERATE_BENCH_SIZE << " products\n";
+            continue;
         }
+        if (!first) json << ",\n";
+        benchmarkCatalog(spec, json, outFile + ".data");
+        first = false;
     }
+    json << "\n  ]\n}\n";
+    json.close();
     
-    file.close();
-    if (file.fail()) {
-        cout << "Error: Failed to write to file!\n";
-        return;
+    initSystem();
+    closeColdStore(outFile + ".cold");
+    cout << "\nBenchmark results written to " << outFile << "\n";
+    return 0;
+}
+
+// ========== TRACE REPLAY ==========
+// Runs a recorded trace against a fresh inventory, either as fast as
+// possible (speed 0) or with the recorded gaps between operations divided
+// by speed (1 = original timing). Saves go to a scratch file instead of the
+// recorded path so a replay never overwrites real data.
+
+bool readTraceInt(istream& in, long long& value) {
+    unsigned long long raw;
+    if (!readVarint(in, raw)) return false;
+    value = (long long)(raw >> 1) ^ -(long long)(raw & 1);
+    return true;
+}
+
+bool readTraceDouble(istream& in, double& value) {
+    return (bool)in.read((char*)&value, sizeof(value));
+}
+
+bool readTraceString(istream& in, string& value) {
+    unsigned long long length;
+    if (!readVarint(in, length) || length > (1ULL << 24)) return false;
+    value.resize(length);
+    return (bool)in.read(&value[0], length);
+}
+
+bool readTraceProduct(istream& in, Product& p) {
+    long long stock, sales, threshold;
+    string name, category;
+    if (!readTraceString(in, p.id) || !readTraceString(in, name) ||
+        !readTraceString(in, category) || !readTraceInt(in, p.price) ||
+        !readTraceDouble(in, p.rating) || !readTraceInt(in, stock) ||
+        !readTraceInt(in, sales) || !readTraceInt(in, threshold)) {
+        return false;
     }
-    
-    cout << "Successfully saved " << count << " products to " << filename << "\n";
+    p.name = name;
+    p.category = category;
+    p.stock = stock;
+    p.sales = sales;
+    p.reorderThreshold = threshold;
+    return true;
 }
 
-void loadFromFile(string filename) {
-    if (filename.empty()) {
-        cout << "Error: Filename cannot be empty!\n";
-        return;
+int runTraceReplay(const string& filename, double speed) {
+    ifstream in(filename, ios::binary);
+    if (!in) {
+        cerr << "Error: Could not open trace file '" << filename << "' for reading!\n";
+        return 1;
     }
     
-    ifstream file(filename);
-    if (!file) {
-        cout << "Error: Could not open file '" << filename << "' for reading!\n";
-        return;
+    char magic[4];
+    if (!in.read(magic, 4) || memcmp(magic, "ITRC", 4) != 0 || in.get() != TRACE_VERSION) {
+        cerr << "Error: '" << filename << "' is not a version " << (int)TRACE_VERSION << " inventory trace!\n";
+        return 1;
     }
     
-    initSystem();
+    string scratchFile = filename + ".replay-save";
+    LatencyHistogram* histograms = new LatencyHistogram[TRACE_OP_COUNT];
+    memset(histograms, 0, sizeof(LatencyHistogram) * TRACE_OP_COUNT);
+    long long records = 0;
+    int missingLoads = 0;
+    bool truncated = false;
+    unsigned long long recordedMicros = 0;
     
-    string line;
-    int count = 0;
-    int lineNum = 0;
+    NullBuffer nullBuffer;
+    streambuf* console = cout.rdbuf(&nullBuffer);
+    chrono::steady_clock::time_point started = chrono::steady_clock::now();
     
-    while (getline(file, line)) {
-        lineNum++;
-        if (line.empty()) continue; // Skip empty lines
+    while (true) {
+        int op = in.get();
+        if (op == EOF) break;
         
+        unsigned long long delta;
         Product p;
-        vector<string> fields;
-        string field = "";
+        string text, from, to;
+        long long sortBy = 0, algorithm = 0, ascending = 0, quantity = 0;
+        long long minPrice = 0, maxPrice = 0;
+        bool ok = op > 0 && op < TRACE_OP_COUNT && readVarint(in, delta);
         
-        for (int i = 0; i < line.length(); i++) {
-            if (line[i] == ',') {
-                fields.push_back(field);
-                field = "";
-            } else {
-                field += line[i];
+        if (ok) {
+            if (op == TRACE_ADD) ok = readTraceProduct(in, p);
+            else if (op == TRACE_UPDATE) ok = readTraceString(in, text) && readTraceProduct(in, p);
+            else if (op == TRACE_DELETE || op == TRACE_SEARCH || op == TRACE_SAVE ||
+                     op == TRACE_LOAD || op == TRACE_MERGE) {
+                ok = readTraceString(in, text);
+            } else if (op == TRACE_SORT) {
+                ok = readTraceInt(in, sortBy) && readTraceInt(in, algorithm) && readTraceInt(in, ascending);
+            } else if (op == TRACE_SORT_SPEC) {
+                ok = readTraceString(in, text) && readTraceInt(in, algorithm);
+            } else if (op == TRACE_RANGE) {
+                ok = readTraceInt(in, minPrice) && readTraceInt(in, maxPrice);
+            } else if (op == TRACE_RESERVE || op == TRACE_RELEASE || op == TRACE_COMMIT || op == TRACE_SELL) {
+                ok = readTraceString(in, text) && readTraceInt(in, quantity);
+            } else if (op == TRACE_PLACE) {
+                ok = readTraceString(in, text) && readTraceString(in, from) && readTraceInt(in, quantity);
+            } else if (op == TRACE_MOVE) {
+                ok = readTraceString(in, text) && readTraceString(in, from) &&
+                     readTraceString(in, to) && readTraceInt(in, quantity);
+            } else if (op == TRACE_LOCATIONS) {
+                ok = readTraceString(in, text) && readTraceString(in, from);
             }
         }
-        fields.push_back(field);
+        if (!ok) {
+            truncated = true;
+            break;
+        }
         
-        if (fields.size() < 7) {
-            cout << "Warning: Line " << lineNum << " has insufficient fields. Skipping...\n";
-            continue;
+        recordedMicros += delta;
+        if (speed > 0) {
+            this_thread::sleep_until(started + chrono::microseconds((long long)(recordedMicros / speed)));
         }
         
-        try {
-            p.id = fields[0];
-            p.name = fields[1];
-            p.category = fields[2];
-            p.price = stod(fields[3]);
-            p.rating = stod(fields[4]);
-            p.stock = stoi(fields[5]);
-            p.sales = stoi(fields[6]);
-            
-            if (isValidProductID(p.id) && isValidProductName(p.name) && 
-                isValidPrice(p.price) && isValidRating(p.rating) &&
-                isValidStock(p.stock) && isValidSales(p.sales)) {
-                addProduct(p);
-                count++;
-            } else {
-                cout << "Warning: Line " << lineNum << " contains invalid data. Skipping...\n";
+        chrono::steady_clock::time_point opStart = chrono::steady_clock::now();
+        if (op == TRACE_ADD) addProduct(p);
+        else if (op == TRACE_UPDATE) updateProduct(text, p);
+        else if (op == TRACE_DELETE) deleteProduct(text);
+        else if (op == TRACE_SEARCH) searchProduct(text);
+        else if (op == TRACE_SORT) sortProducts(singleKeySpec(sortBy, ascending != 0), algorithm);  // older traces
+        else if (op == TRACE_SORT_SPEC) {
+            SortSpec spec;
+            string error;
+            if (parseSortSpec(text, spec, error)) sortProducts(spec, algorithm);
+        }
+        else if (op == TRACE_RANGE) rangeSearch(minPrice, maxPrice);
+        else if (op == TRACE_RESERVE) reserveStock(text, quantity);
+        else if (op == TRACE_RELEASE) releaseStock(text, quantity);
+        else if (op == TRACE_COMMIT) commitStock(text, quantity);
+        else if (op == TRACE_SELL) incrementSales(text, quantity);
+        else if (op == TRACE_PLACE) setLocationStock(text, from, quantity);
+        else if (op == TRACE_MOVE) moveStock(text, from, to, quantity);
+        else if (op == TRACE_LOCATIONS) {
+            HashNode* node = findHashNode(text);
+            vector<LocationStock> locations;
+            string error;
+            if (node != NULL && parseLocationsField(from, node->product.stock, locations, error)) {
+                assignLocations(node, locations);
             }
-        } catch (const invalid_argument& e) {
-            cout << "Warning: Line " << lineNum << " contains invalid number format. Skipping...\n";
-        } catch (const out_of_range& e) {
-            cout << "Warning: Line " << lineNum << " contains number out of range. Skipping...\n";
         }
+        else if (op == TRACE_UNDO) undoOperation();
+        else if (op == TRACE_REDO) redoOperation();
+        else if (op == TRACE_SAVE) saveToFile(scratchFile);
+        else if (op == TRACE_LOAD || op == TRACE_MERGE) {
+            ifstream check(text);
+            if (!check) missingLoads++;
+            if (op == TRACE_LOAD) loadFromFile(text);
+            else mergeFromFile(text);
+        }
+        addLatencySample(histograms[op], chrono::duration_cast<chrono::nanoseconds>(
+                                             chrono::steady_clock::now() - opStart).count());
+        records++;
     }
     
-    file.close();
-    cout << "Successfully loaded " << count << " products from " << filename << "\n";
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - started;
+    cout.rdbuf(console);
+    remove(scratchFile.c_str());
+    
+    cout << "\n=== TRACE REPLAY ===\n";
+    cout << "Trace:      " << filename << (truncated ? " (truncated, stopped at bad record)" : "") << "\n";
+    cout << "Timing:     ";
+    if (speed > 0) cout << speed << "x recorded speed\n";
+    else cout << "full speed\n";
+    cout << "Operations: " << records << " in " << fixed << setprecision(3) << elapsed.count()
+         << " s (" << setprecision(0) << (elapsed.count() > 0 ? records / elapsed.count() : 0) << " ops/s)\n";
+    cout << "Recorded:   " << setprecision(3) << recordedMicros / 1e6 << " s of original activity\n";
+    if (missingLoads > 0) {
+        cout << "Warning: " << missingLoads << " load(s) referenced files that do not exist here.\n";
+    }
+    
+    cout << "\n" << left << setw(10) << "Operation" << right << setw(10) << "Count"
+         << setw(12) << "Mean(us)" << setw(11) << "p50(us)" << setw(11) << "p99(us)"
+         << setw(12) << "Max(us)" << "\n";
+    cout << string(66, '-') << "\n";
+    cout << setprecision(2);
+    for (int op = 1; op < TRACE_OP_COUNT; op++) {
+        const LatencyHistogram& h = histograms[op];
+        if (h.count == 0) continue;
+        cout << left << setw(10) << traceOpNames[op] << right << setw(10) << h.count
+             << setw(12) << h.totalNs / 1000.0 / h.count
+             << setw(11) << histogramPercentile(h, 50) / 1000.0
+             << setw(11) << histogramPercentile(h, 99) / 1000.0
+             << setw(12) << h.maxNs / 1000.0 << "\n";
+    }
+    cout << string(66, '-') << "\n";
+    
+    delete[] histograms;
+    return truncated ? 1 : 0;
 }
 
 void displayMenu() {
@@ -842,7 +6140,12 @@ void displayMenu() {
     cout << "9. Redo Last Operation\n";
     cout << "10. Save to File\n";
     cout << "11. Load from File\n";
-    cout << "12. Exit\n";
+    cout << "12. Low Stock Report\n";
+    cout << "13. Statistics\n";
+    cout << "14. Sales Trends\n";
+    cout << "15. Browse Sorted View\n";
+    cout << "16. Warehouse Stock\n";
+    cout << "17. Exit\n";
     cout << "============================\n";
 }
 
@@ -866,16 +6169,91 @@ void orderMenu() {
     cout << "2. Descending\n";
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     initSystem();
     
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        return runBenchmark(argc, argv);
+    }
+    
+    if (argc > 1 && string(argv[1]) == "--replay") {
+        if (argc < 3) {
+            cerr << "Usage: " << argv[0] << " --replay <trace file> [speed, 0 = full speed]\n";
+            return 1;
+        }
+        return runTraceReplay(argv[2], argc > 3 ? atof(argv[3]) : 0.0);
+    }
+    
+    // INVENTORY_TRACE=<file> records every operation of this session.
+    const char* traceFile = getenv("INVENTORY_TRACE");
+    if (traceFile != NULL && !startTraceRecording(traceFile)) {
+        return 1;
+    }
+    
+    // INVENTORY_FEED_LOG=<file> appends every change event to the file.
+    const char* feedLogFile = getenv("INVENTORY_FEED_LOG");
+    if (feedLogFile != NULL && !startFeedLog(feedLogFile)) {
+        return 1;
+    }
+    
+    // INVENTORY_QUERY_CACHE_KB=<n> sets the memory budget of the query cache.
+    const char* queryCacheText = getenv("INVENTORY_QUERY_CACHE_KB");
+    if (queryCacheText != NULL) {
+        if (!isValidIntInput(queryCacheText) || atoi(queryCacheText) < 0) {
+            cerr << "Error: INVENTORY_QUERY_CACHE_KB must be a non-negative number!\n";
+            return 1;
+        }
+        setQueryCacheBudget((size_t)atoi(queryCacheText) * 1024);
+    }
+    
+    // INVENTORY_COLD_STORE=<file> keeps at most INVENTORY_HOT_LIMIT products
+    // in memory and pages the rest through INVENTORY_CACHE_PAGES 4 KiB pages.
+    const char* coldFile = getenv("INVENTORY_COLD_STORE");
+    if (coldFile != NULL) {
+        const char* hotText = getenv("INVENTORY_HOT_LIMIT");
+        const char* cacheText = getenv("INVENTORY_CACHE_PAGES");
+        int hotLimit = hotText != NULL ? atoi(hotText) : 100000;
+        int cachePages = cacheText != NULL ? atoi(cacheText) : 256;
+        if (hotLimit <= 0 || cachePages <= 0) {
+            cerr << "Error: INVENTORY_HOT_LIMIT and INVENTORY_CACHE_PAGES must be positive!\n";
+            return 1;
+        }
+        if (!openColdStore(coldFile, hotLimit, cachePages)) return 1;
+    }
+    
+    if (argc > 1 && (string(argv[1]) == "--serve" || string(argv[1]) == "--loadgen")) {
+#ifdef __linux__
+        string mode = argv[1];
+        string address = argc > 2 ? argv[2] : "tcp:5050";
+        if (mode == "--serve") {
+            // Optional catalog to serve: --serve <address> <file>
+            if (argc > 3) loadFromFile(argv[3]);
+            return runQueryServer(address);
+        }
+        int requests = argc > 3 ? atoi(argv[3]) : 100000;
+        int depth = argc > 4 ? atoi(argv[4]) : 32;
+        int catalog = argc > 5 ? atoi(argv[5]) : 1000;
+        if (requests <= 0 || depth <= 0 || catalog <= 0) {
+            cerr << "Usage: " << argv[0] << " --loadgen [address] [requests] [pipeline depth] [catalog size]\n";
+            return 1;
+        }
+        return runLoadGenerator(address, requests, depth, catalog);
+#else
+        cerr << "Error: Server mode is only supported on Linux.\n";
+        return 1;
+#endif
+    }
+    
+    setLowStockCallback(printLowStockAlert);
+    
     cout << "========================================\n";
     cout << "   INVENTORY TRACK PRO - DSA PROJECT   \n";
     cout << "========================================\n";
     
     while (true) {
+        finishBackgroundSave(false, cout);
         displayMenu();
-        int choice = getMenuChoice(1, 12);
+        int choice = getMenuChoice(1, 17);
         
         if (choice == 1) {
             Product p;
@@ -889,10 +6267,11 @@ int main() {
             
             p.name = getStringInput("Enter Product Name: ");
             p.category = getStringInput("Enter Category: ");
-            p.price = getDoubleInput("Enter Price: $", 0.0, 1000000.0);
+            p.price = getMoneyInput("Enter Price: $", 0, 1000000 * PRICE_SCALE);
             p.rating = getDoubleInput("Enter Rating (0-5): ", 0.0, 5.0);
             p.stock = getIntInput("Enter Stock: ", 0, 1000000);
             p.sales = getIntInput("Enter Sales: ", 0, 1000000);
+            p.reorderThreshold = getIntInput("Enter Reorder Threshold: ", 0, 1000000);
             
             addProduct(p);
         }
@@ -906,10 +6285,11 @@ int main() {
                 cout << "ID: " << p->id << "\n";
                 cout << "Name: " << p->name << "\n";
                 cout << "Category: " << p->category << "\n";
-                cout << "Price: $" << fixed << setprecision(2) << p->price << "\n";
+                cout << "Price: $" << formatMoney(p->price) << "\n";
                 cout << "Rating: " << fixed << setprecision(1) << p->rating << "\n";
                 cout << "Stock: " << p->stock << "\n";
                 cout << "Sales: " << p->sales << "\n";
+                cout << "Reorder Threshold: " << p->reorderThreshold << "\n";
             } else {
                 cout << "Product not found!\n";
             }
@@ -925,10 +6305,11 @@ int main() {
                 cout << "\nCurrent Product Information:\n";
                 cout << "Name: " << old->name << "\n";
                 cout << "Category: " << old->category << "\n";
-                cout << "Price: $" << fixed << setprecision(2) << old->price << "\n";
+                cout << "Price: $" << formatMoney(old->price) << "\n";
                 cout << "Rating: " << fixed << setprecision(1) << old->rating << "\n";
                 cout << "Stock: " << old->stock << "\n";
                 cout << "Sales: " << old->sales << "\n";
+                cout << "Reorder Threshold: " << old->reorderThreshold << "\n";
                 
                 cout << "\nEnter new values (press Enter to keep current value):\n";
                 
@@ -941,8 +6322,8 @@ int main() {
                 while (true) {
                     input = getStringInput("New Price (press Enter to skip): ");
                     if (input.empty()) break;
-                    if (isValidDoubleInput(input)) {
-                        double price = stod(input);
+                    Money price;
+                    if (parseMoney(input, price)) {
                         if (isValidPrice(price)) {
                             newProduct.price = price;
                             break;
@@ -1002,6 +6383,22 @@ int main() {
                     }
                 }
                 
+                while (true) {
+                    input = getStringInput("New Reorder Threshold (press Enter to skip): ");
+                    if (input.empty()) break;
+                    if (isValidIntInput(input)) {
+                        int threshold = stoi(input);
+                        if (isValidReorderThreshold(threshold)) {
+                            newProduct.reorderThreshold = threshold;
+                            break;
+                        } else {
+                            cout << "Error: Reorder threshold must be non-negative!\n";
+                        }
+                    } else {
+                        cout << "Error: Invalid threshold format!\n";
+                    }
+                }
+                
                 updateProduct(id, newProduct);
             } else {
                 cout << "Product not found!\n";
@@ -1029,24 +6426,37 @@ int main() {
             cout << "\n=== SORT PRODUCTS ===\n";
             
             sortMenu();
-            int sortBy = getMenuChoice(1, 3);
+            cout << "4. Several Fields\n";
+            int sortBy = getMenuChoice(1, 4);
+            
+            SortSpec spec;
+            while (sortBy == 4) {
+                cout << "Fields: id, name, category, price, rating, stock, sales, threshold\n";
+                string text = getStringInput("Sort by (e.g. category asc, sales desc, name asc): ");
+                string error;
+                if (parseSortSpec(text, spec, error)) break;
+                cout << "Error: " << error << "!\n";
+            }
             
             algorithmMenu();
             int algorithm = getMenuChoice(1, 2);
             
-            orderMenu();
-            int order = getMenuChoice(1, 2);
+            if (sortBy != 4) {
+                orderMenu();
+                int order = getMenuChoice(1, 2);
+                spec = singleKeySpec(sortBy, order == 1);
+            }
             
-            sortProducts(sortBy, algorithm, order == 1);
+            sortProducts(spec, algorithm);
         }
         else if (choice == 7) {
             cout << "\n=== RANGE SEARCH BY PRICE ===\n";
             
-            double minPrice = getDoubleInput("Enter minimum price: $", 0.0, 1000000.0);
-            double maxPrice;
+            Money minPrice = getMoneyInput("Enter minimum price: $", 0, 1000000 * PRICE_SCALE);
+            Money maxPrice;
             
             while (true) {
-                maxPrice = getDoubleInput("Enter maximum price: $", 0.0, 1000000.0);
+                maxPrice = getMoneyInput("Enter maximum price: $", 0, 1000000 * PRICE_SCALE);
                 if (maxPrice >= minPrice) break;
                 cout << "Error: Maximum price must be greater than or equal to minimum price!\n";
             }
@@ -1062,30 +6472,107 @@ int main() {
         else if (choice == 10) {
             cout << "\n=== SAVE TO FILE ===\n";
             string filename = getStringInput("Enter filename to save (e.g., products.txt): ");
-            saveToFile(filename);
+            if (saveInBackground(filename)) {
+                cout << "Saving to " << filename << " in the background; you can keep working.\n";
+            }
         }
         else if (choice == 11) {
             cout << "\n=== LOAD FROM FILE ===\n";
             string filename = getStringInput("Enter filename to load (e.g., products.txt): ");
             
-            cout << "Warning: Loading from file will replace current inventory. Continue? (y/n): ";
+            cout << "1. Replace Current Inventory\n";
+            cout << "2. Merge Changes Only\n";
+            int mode = getMenuChoice(1, 2);
+            
+            if (mode == 1) cout << "Warning: Loading from file will replace current inventory. Continue? (y/n): ";
+            else cout << "Warning: Products missing from the file will be deleted. Continue? (y/n): ";
             char confirm;
             cin >> confirm;
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
             
             if (confirm == 'y' || confirm == 'Y') {
-                loadFromFile(filename);
+                if (mode == 1) loadFromFile(filename);
+                else mergeFromFile(filename);
             } else {
                 cout << "Load operation cancelled.\n";
             }
         }
         else if (choice == 12) {
+            displayLowStockReport();
+        }
+        else if (choice == 13) {
+            displayStats();
+        }
+        else if (choice == 14) {
+            cout << "\n=== SALES TRENDS ===\n";
+            int days = getIntInput("Enter period in days: ", 1, 90);
+            displaySalesTrends(days);
+        }
+        else if (choice == 15) {
+            sortMenu();
+            int sortBy = getMenuChoice(1, 3);
+            orderMenu();
+            bool ascending = getMenuChoice(1, 2) == 1;
+            
+            cout << "\n=== BROWSE SORTED VIEW ===\n";
+            cout << "1. Show a Page\n";
+            cout << "2. Find Rank of a Product\n";
+            if (getMenuChoice(1, 2) == 1) {
+                int pageSize = getIntInput("Products per page: ", 1, 1000);
+                int page = getIntInput("Page number: ", 1, 1000000);
+                displaySortedPage(sortBy, ascending, page, pageSize);
+            } else {
+                string id = getStringInput("Enter Product ID: ");
+                applyStockBatch();
+                int rank = productRank(id, sortBy, ascending);
+                if (rank > 0) cout << "'" << id << "' is ranked " << rank << " of " << viewSize(sortedViews[sortBy - 1]) << ".\n";
+                else cout << "Product not found!\n";
+            }
+        }
+        else if (choice == 16) {
+            cout << "\n=== WAREHOUSE STOCK ===\n";
+            cout << "1. Set Stock at a Location\n";
+            cout << "2. Move Stock Between Locations\n";
+            cout << "3. Where Is a Product\n";
+            cout << "4. Warehouse Totals\n";
+            int action = getMenuChoice(1, 4);
+            
+            if (action == 4) {
+                displayWarehouseTotals();
+            } else {
+                string id = getStringInput("Enter Product ID: ");
+                if (action == 1) {
+                    string location = getStringInput("Enter Location: ");
+                    int quantity = getIntInput("Enter Stock at this Location: ", 0, 1000000);
+                    if (setLocationStock(id, location, quantity)) cout << "Location stock updated successfully!\n";
+                } else if (action == 2) {
+                    string from = getStringInput("From Location: ");
+                    string to = getStringInput("To Location: ");
+                    int quantity = getIntInput("Quantity to Move: ", 1, 1000000);
+                    if (moveStock(id, from, to, quantity)) cout << "Stock moved successfully!\n";
+                } else {
+                    vector<LocationStock> locations;
+                    if (!productLocations(id, locations)) {
+                        cout << "Product not found!\n";
+                    } else if (locations.empty()) {
+                        cout << "'" << id << "' is out of stock everywhere.\n";
+                    } else {
+                        for (size_t i = 0; i < locations.size(); i++) {
+                            cout << left << setw(20) << locationNames[locations[i].location]
+                                 << locations[i].quantity << "\n";
+                        }
+                    }
+                }
+            }
+        }
+        else if (choice == 17) {
             cout << "\nAre you sure you want to exit? Any unsaved changes will be lost. (y/n): ";
             char confirm;
             cin >> confirm;
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
             
             if (confirm == 'y' || confirm == 'Y') {
+                finishBackgroundSave(true, cout);
                 cout << "Thank you for using Inventory Track Pro!\n";
                 break;
             }